@@ -681,6 +681,8 @@ __SYSCALL(__NR_syncfs, sys_syncfs)
 __SYSCALL(__NR_sendmmsg, sys_sendmmsg)
 #define __NR_setns				308
 __SYSCALL(__NR_setns, sys_setns)
+#define __NR_sched_ss_complete			309
+__SYSCALL(__NR_sched_ss_complete, sys_sched_ss_complete)
 
 #ifndef __NO_STUBS
 #define __ARCH_WANT_OLD_READDIR
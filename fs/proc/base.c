@@ -1447,6 +1447,38 @@ static const struct file_operations proc_pid_sched_operations = {
 
 #endif
 
+/*
+ * Read-only mapping of the SCHED_SPORADIC status page of the task, see
+ * struct sched_ss_status.
+ */
+static int proc_ss_status_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct task_struct *task;
+	struct page *page;
+	int ret;
+
+	if (vma->vm_pgoff || vma->vm_end - vma->vm_start != PAGE_SIZE)
+		return -EINVAL;
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+	vma->vm_flags &= ~VM_MAYWRITE;
+
+	task = get_proc_task(file->f_path.dentry->d_inode);
+	if (!task)
+		return -ESRCH;
+
+	page = sched_ss_status_page(task);
+	ret = page ? vm_insert_page(vma, vma->vm_start, page) : -ENOMEM;
+
+	put_task_struct(task);
+	return ret;
+}
+
+static const struct file_operations proc_ss_status_operations = {
+	.mmap		= proc_ss_status_mmap,
+	.llseek		= noop_llseek,
+};
+
 #ifdef CONFIG_SCHED_AUTOGROUP
 /*
  * Print out autogroup related information:
@@ -2781,6 +2813,7 @@ static const struct pid_entry tgid_base_stuff[] = {
 #ifdef CONFIG_SCHED_DEBUG
 	REG("sched",      S_IRUGO|S_IWUSR, proc_pid_sched_operations),
 #endif
+	REG("ss_status", S_IRUGO, proc_ss_status_operations),
 #ifdef CONFIG_SCHED_AUTOGROUP
 	REG("autogroup",  S_IRUGO|S_IWUSR, proc_pid_sched_autogroup_operations),
 #endif
@@ -3130,6 +3163,7 @@ static const struct pid_entry tid_base_stuff[] = {
 #ifdef CONFIG_SCHED_DEBUG
 	REG("sched",     S_IRUGO|S_IWUSR, proc_pid_sched_operations),
 #endif
+	REG("ss_status", S_IRUGO, proc_ss_status_operations),
 	REG("comm",      S_IRUGO|S_IWUSR, proc_pid_set_comm_operations),
 #ifdef CONFIG_HAVE_ARCH_TRACEHOOK
 	INF("syscall",   S_IRUGO, proc_pid_syscall),
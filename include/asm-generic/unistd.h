@@ -685,9 +685,11 @@ __SYSCALL(__NR_syncfs, sys_syncfs)
 __SYSCALL(__NR_setns, sys_setns)
 #define __NR_sendmmsg 269
 __SC_COMP(__NR_sendmmsg, sys_sendmmsg, compat_sys_sendmmsg)
+#define __NR_sched_ss_complete 270
+__SYSCALL(__NR_sched_ss_complete, sys_sched_ss_complete)
 
 #undef __NR_syscalls
-#define __NR_syscalls 270
+#define __NR_syscalls 271
 
 /*
  * All syscalls below here should go away really,
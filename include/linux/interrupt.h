@@ -136,6 +136,8 @@ extern int __must_check
 request_any_context_irq(unsigned int irq, irq_handler_t handler,
 			unsigned long flags, const char *name, void *dev_id);
 
+extern int irq_set_thread_server(unsigned int irq, u64 budget, u64 period);
+
 extern void exit_irq_thread(void);
 #else
 
@@ -164,6 +166,12 @@ request_any_context_irq(unsigned int irq, irq_handler_t handler,
 	return request_irq(irq, handler, flags, name, dev_id);
 }
 
+static inline int irq_set_thread_server(unsigned int irq, u64 budget,
+					u64 period)
+{
+	return -ENOSYS;
+}
+
 static inline void exit_irq_thread(void) { }
 #endif
 
@@ -63,6 +63,8 @@ struct irq_desc {
 	unsigned long		threads_oneshot;
 	atomic_t		threads_active;
 	wait_queue_head_t       wait_for_threads;
+	u64			ss_budget;	/* handler thread server, ns */
+	u64			ss_period;
 #ifdef CONFIG_PROC_FS
 	struct proc_dir_entry	*dir;
 #endif
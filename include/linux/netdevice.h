@@ -441,6 +441,7 @@ typedef enum rx_handler_result rx_handler_result_t;
 typedef rx_handler_result_t rx_handler_func_t(struct sk_buff **pskb);
 
 extern void __napi_schedule(struct napi_struct *n);
+extern int dev_set_napi_server(struct net_device *dev, u64 budget, u64 period);
 
 static inline int napi_disable_pending(struct napi_struct *n)
 {
@@ -1026,6 +1027,13 @@ struct net_device {
 	struct list_head	napi_list;
 	struct list_head	unreg_list;
 
+	/* NAPI polled by a SCHED_SPORADIC server, see dev_set_napi_server() */
+	struct task_struct	*napi_thread;
+	spinlock_t		napi_lock;
+	struct list_head	napi_poll_list;
+	u64			napi_ss_budget;
+	u64			napi_ss_period;
+
 	/* currently active device features */
 	u32			features;
 	/* user-changeable features */
@@ -48,6 +48,32 @@
  */
 /* TODO: allow to be set in .config */
 #define SS_REPL_MAX 100
+
+/*
+ * SCHED_SPORADIC server modes (sched_param.sched_ss_mode)
+ *
+ * SS_MODE_SPORADIC: consumed capacity is replenished one period after the
+ * activation that used it.
+ * SS_MODE_POLLING: the full budget is replenished at each period boundary
+ * and the remaining capacity is forfeited when the task blocks.
+ * SS_MODE_DEFERRABLE: as polling, but the remaining capacity is kept across
+ * blocking until the period boundary.
+ */
+#define SS_MODE_SPORADIC	0
+#define SS_MODE_POLLING		1
+#define SS_MODE_DEFERRABLE	2
+
+/*
+ * What an exhausted SCHED_SPORADIC task does until its next replenishment
+ * (sched_param.sched_ss_bg_policy)
+ *
+ * SS_BG_SUSPEND: it does not run at all.
+ * SS_BG_RT: it runs at sched_ss_low_priority.
+ * SS_BG_FAIR: it runs in the fair class at its nice level, as SCHED_NORMAL.
+ */
+#define SS_BG_SUSPEND		0
+#define SS_BG_RT		1
+#define SS_BG_FAIR		2
  
 #ifdef __KERNEL__
 
@@ -102,13 +128,170 @@ struct sched_param {
 	struct timespec sched_ss_repl_period;
 	struct timespec sched_ss_init_budget;
 	int sched_ss_max_repl;
+	int sched_ss_mode;
+	int sched_ss_bg_policy;
+	/*
+	 * A polling or deferrable task with a non-zero sched_ss_max_budget
+	 * has its budget adapted to its consumption, between these bounds,
+	 * starting from sched_ss_init_budget.
+	 */
+	struct timespec sched_ss_min_budget;
+	struct timespec sched_ss_max_budget;
 };
 
+/*
+ * Live state of a SCHED_SPORADIC task, in a page that can be mapped
+ * read-only from /proc/<pid>/ss_status.  Times are CLOCK_MONOTONIC ns.
+ *
+ * seq is odd while the page is being updated: read it, then the fields,
+ * and retry if seq was odd or changed meanwhile.  capacity is the budget
+ * left as of stamp; while the task runs in fg it shrinks by the time since.
+ * next_repl is when next_amt is added to it, 0 if nothing is pending.
+ */
+struct sched_ss_status {
+	unsigned int seq;
+	unsigned int flags;
+	long long stamp;
+	long long capacity;
+	long long next_repl;
+	long long next_amt;
+	long long budget;
+	long long period;
+};
+
+/* sched_ss_status.flags */
+#define SS_STATUS_ACTIVE	0x1	/* the task is SCHED_SPORADIC */
+#define SS_STATUS_FG		0x2	/* it is at its fg priority */
+
 struct sched_ss_repl {
 	ktime_t amt;
 	ktime_t time;
 };
 
+#define SS_LAT_BUCKETS	20
+
+/*
+ * SCHED_SPORADIC statistics, kept per server and summed per cpu.
+ * Bucket 0 of lat_hist counts wakeup to fg latencies below 1us, bucket i
+ * the ones below 2^i us.
+ */
+struct sched_ss_stats {
+	unsigned long nr_repl;
+	unsigned long nr_exhaust;
+	unsigned long nr_overrun;
+	u64 overrun_max;
+	u64 overrun_sum;
+	unsigned long nr_period_skip;
+	unsigned long nr_nobudget;
+	u64 fg_runtime;
+	u64 bg_runtime;
+	/* part of fg_runtime consumed by lock owners it boosted */
+	u64 pi_runtime;
+	/* budget given to and drawn from the slack pool of the cpu */
+	u64 slack_given;
+	u64 slack_drawn;
+	/* jobs completed with sched_ss_complete(), and their runtime */
+	unsigned long nr_jobs;
+	u64 job_runtime_sum;
+	u64 job_runtime_max;
+	unsigned long lat_hist[SS_LAT_BUCKETS];
+};
+
+/* adaptive budget controller state, see ss_ctl_period() */
+struct sched_ss_ctl {
+	/* bounds of the budget, max_budget is 0 when it is not adapted */
+	ktime_t min_budget;
+	ktime_t max_budget;
+	/* average consumption per period, in ns */
+	u64 avg_used;
+	/* average share of periods that ended in exhaustion, per mille */
+	unsigned int exh_rate;
+	/* fg_runtime and nr_exhaust at the last period boundary */
+	u64 last_runtime;
+	unsigned long last_exhaust;
+	/* budget changes made, and the ones admission control refused */
+	unsigned long nr_adjust;
+	unsigned long nr_denied;
+};
+
+/*
+ * SCHED_SPORADIC server state.  Only tasks using the policy have one, it is
+ * allocated by sched_setscheduler() and freed with the task.
+ */
+struct sched_ss_server {
+	/* the task served, NULL for a group server */
+	struct task_struct *task;
+	/* fg priority, kernel representation */
+	int prio;
+#ifdef CONFIG_RT_GROUP_SCHED
+	/* group server: the rt_rq served and whether an activation is in
+	 * progress.  In bg the rt_rq is throttled. */
+	struct rt_rq *rt_rq;
+	int fg;
+#endif
+
+	/* fg (high) priority is the same as rt_priority.  rt_priority is only
+	 * changed by the user and is not affected by priority inheritance, etc. */
+	int low_priority;
+	ktime_t repl_period;
+	ktime_t init_budget;
+	/* budget and period from sched_setscheduler() that take effect at the
+	 * next replenishment, next_budget is 0 if there are none */
+	ktime_t next_budget;
+	ktime_t next_period;
+	int max_repl;
+	int mode;
+	/* SS_BG_*, always SS_BG_SUSPEND for a group server */
+	int bg_policy;
+	struct sched_ss_ctl ctl;
+
+	/* ring of max_repl+1 entries: the front entry and pending replenishments */
+	struct sched_ss_repl *repl_list;
+	int repl_head;
+	int nr_repl;
+	ktime_t usage;
+	/* drawn from the slack pool of the rq and not used yet, it is used
+	 * before the budget and dropped when the fg activation ends */
+	ktime_t slack;
+	/* capacity to be taken off the next capacity added: overruns of a
+	 * polling or deferrable server */
+	ktime_t debt;
+	/* start of the current fg activation, used to time its replenishment */
+	ktime_t act_time;
+
+	/* when the next replenishment, or for a polling or deferrable server
+	 * the next period boundary, is due */
+	ktime_t repl_expires;
+	/* queued on the replenishment timer queue of repl_rq, NULL if not
+	 * queued; a stopped server is not queued again */
+	struct timerqueue_node repl_node;
+	struct rq *repl_rq;
+	int stopped;
+
+	/* see also the sched_ss_* tracepoints */
+	struct sched_ss_stats stats;
+	/* since when the server waits for fg after a wakeup, 0 if it does not */
+	ktime_t wakeup;
+	/* server start, for the fraction of the budget used */
+	ktime_t start;
+	/* sum_exec_runtime of the task when its current job started */
+	u64 job_start;
+
+	/* admission control: reserved utilization, the cpu it is charged to
+	 * (-1 when not pinned) and the list of servers charged there */
+	u64 bw;
+	int bw_cpu;
+	struct list_head bw_node;
+	/* pinned to bw_cpu by the placement policy, and moved by a repack
+	 * while its task is not pinned there yet */
+	int placed;
+	int place_moved;
+	/* the cpus the task allowed itself before it was placed */
+	cpumask_t place_mask;
+
+	struct rcu_head rcu;
+};
+
 struct exec_domain;
 struct futex_pi_state;
 struct robust_list_head;
@@ -1215,6 +1398,18 @@ struct sched_rt_entity {
 	int nr_cpus_allowed;
 
 	struct sched_rt_entity *back;
+	/* SCHED_SPORADIC server, NULL for other policies */
+	struct sched_ss_server *ss;
+	/* status page, allocated when first mapped */
+	struct sched_ss_status *ss_status;
+#ifdef CONFIG_RT_MUTEXES
+	/* blocked server whose budget this task runs on while boosted */
+	struct task_struct *ss_donor;
+	/* runtime not yet charged to the donor */
+	u64 ss_donor_debt;
+	/* the donor ran out, the boost is to be dropped */
+	int ss_donor_exhausted;
+#endif
 #ifdef CONFIG_RT_GROUP_SCHED
 	struct sched_rt_entity	*parent;
 	/* rq on which this entity is (to be) queued: */
@@ -1249,25 +1444,6 @@ struct task_struct {
 	int prio, static_prio, normal_prio;
 	unsigned int rt_priority;
 
-	/* SCHED_SPORADIC scheduling parameters */
-	/* TODO: really should be placed in struct sched_rt_entity,
-	 * but do not want to deal with group scheduling, etc. now */
-
-	/* fg (high) priority is the same as rt_priority.  rt_priority is only
-	 * changed by the user and is not affected by priority inheritance, etc. */
-	int sched_ss_low_priority;
-	ktime_t sched_ss_repl_period;
-	ktime_t sched_ss_init_budget;
-	int sched_ss_max_repl;
-
-	struct sched_ss_repl ss_repl_list[SS_REPL_MAX];
-	int repl_head;
-	ktime_t ss_usage;
-
-	/* SCHED_SPORADIC timers */
-	struct hrtimer ss_repl_timer;
-	struct hrtimer ss_exh_timer;
-
 	const struct sched_class *sched_class;
 	struct sched_entity se;
 	struct sched_rt_entity rt;
@@ -2034,6 +2210,8 @@ static inline unsigned int get_sysctl_timer_migration(void)
 #endif
 extern unsigned int sysctl_sched_rt_period;
 extern int sysctl_sched_rt_runtime;
+extern unsigned int sysctl_sched_ss_timer_slack;
+extern unsigned int sysctl_sched_ss_placement;
 
 int sched_rt_handler(struct ctl_table *table, int write,
 		void __user *buffer, size_t *lenp,
@@ -2060,6 +2238,7 @@ static inline void sched_autogroup_exit(struct signal_struct *sig) { }
 #ifdef CONFIG_RT_MUTEXES
 extern int rt_mutex_getprio(struct task_struct *p);
 extern void rt_mutex_setprio(struct task_struct *p, int prio);
+extern struct task_struct *rt_mutex_ss_donor(struct task_struct *p);
 extern void rt_mutex_adjust_pi(struct task_struct *p);
 #else
 static inline int rt_mutex_getprio(struct task_struct *p)
@@ -2152,7 +2331,9 @@ extern void wake_up_new_task(struct task_struct *tsk);
 #else
  static inline void kick_process(struct task_struct *tsk) { }
 #endif
-extern void sched_fork(struct task_struct *p);
+extern int sched_fork(struct task_struct *p);
+extern void sched_ss_free(struct task_struct *p);
+extern struct page *sched_ss_status_page(struct task_struct *p);
 extern void sched_dead(struct task_struct *p);
 
 extern void proc_caches_init(void);
@@ -391,6 +391,201 @@ TRACE_EVENT(sched_pi_setprio,
 			__entry->oldprio, __entry->newprio)
 );
 
+/*
+ * Tracepoints for SCHED_SPORADIC servers.  A group server has no task,
+ * it is shown with pid -1.
+ */
+DECLARE_EVENT_CLASS(sched_ss_template,
+
+	TP_PROTO(struct sched_ss_server *ss),
+
+	TP_ARGS(ss),
+
+	TP_STRUCT__entry(
+		__array( char,	comm,	TASK_COMM_LEN	)
+		__field( pid_t,	pid			)
+		__field( s64,	budget			)
+		__field( s64,	usage			)
+		__field( s64,	expires			)
+	),
+
+	TP_fast_assign(
+		if (ss->task) {
+			memcpy(__entry->comm, ss->task->comm, TASK_COMM_LEN);
+			__entry->pid	= ss->task->pid;
+		} else {
+			memset(__entry->comm, 0, TASK_COMM_LEN);
+			__entry->pid	= -1;
+		}
+		__entry->budget		= ktime_to_ns(ss->repl_list[ss->repl_head].amt);
+		__entry->usage		= ktime_to_ns(ss->usage);
+		__entry->expires	= ktime_to_ns(ss->repl_expires);
+	),
+
+	TP_printk("comm=%s pid=%d budget=%Ld [ns] usage=%Ld [ns] expires=%Ld",
+			__entry->comm, __entry->pid,
+			(long long)__entry->budget,
+			(long long)__entry->usage,
+			(long long)__entry->expires)
+);
+
+/*
+ * Tracepoint for a replenishment or period boundary adding capacity:
+ */
+DEFINE_EVENT(sched_ss_template, sched_ss_replenish,
+	     TP_PROTO(struct sched_ss_server *ss),
+	     TP_ARGS(ss));
+
+/*
+ * Tracepoint for a server running out of budget:
+ */
+DEFINE_EVENT(sched_ss_template, sched_ss_exhaust,
+	     TP_PROTO(struct sched_ss_server *ss),
+	     TP_ARGS(ss));
+
+/*
+ * Tracepoint for a server that consumed more than its capacity:
+ */
+TRACE_EVENT(sched_ss_overrun,
+
+	TP_PROTO(struct sched_ss_server *ss, s64 overrun),
+
+	TP_ARGS(ss, overrun),
+
+	TP_STRUCT__entry(
+		__field( pid_t,	pid			)
+		__field( s64,	budget			)
+		__field( s64,	overrun			)
+	),
+
+	TP_fast_assign(
+		__entry->pid		= ss->task ? ss->task->pid : -1;
+		__entry->budget		= ktime_to_ns(ss->repl_list[ss->repl_head].amt);
+		__entry->overrun	= overrun;
+	),
+
+	TP_printk("pid=%d budget=%Ld [ns] overrun=%Ld [ns]",
+			__entry->pid, (long long)__entry->budget,
+			(long long)__entry->overrun)
+);
+
+/*
+ * Tracepoint for a polling/deferrable server timer that fired late and
+ * skipped period boundaries:
+ */
+TRACE_EVENT(sched_ss_period_skip,
+
+	TP_PROTO(struct sched_ss_server *ss, int periods),
+
+	TP_ARGS(ss, periods),
+
+	TP_STRUCT__entry(
+		__field( pid_t,	pid			)
+		__field( int,	periods			)
+		__field( s64,	expires			)
+	),
+
+	TP_fast_assign(
+		__entry->pid		= ss->task ? ss->task->pid : -1;
+		__entry->periods	= periods;
+		__entry->expires	= ktime_to_ns(ss->repl_expires);
+	),
+
+	TP_printk("pid=%d periods=%d expires=%Ld",
+			__entry->pid, __entry->periods,
+			(long long)__entry->expires)
+);
+
+/*
+ * Tracepoint for a task completing its job and giving up its capacity:
+ */
+TRACE_EVENT(sched_ss_job_complete,
+
+	TP_PROTO(struct sched_ss_server *ss, u64 runtime),
+
+	TP_ARGS(ss, runtime),
+
+	TP_STRUCT__entry(
+		__field( pid_t,	pid			)
+		__field( u64,	runtime			)
+		__field( s64,	budget			)
+		__field( s64,	usage			)
+	),
+
+	TP_fast_assign(
+		__entry->pid		= ss->task ? ss->task->pid : -1;
+		__entry->runtime	= runtime;
+		__entry->budget		= ktime_to_ns(ss->repl_list[ss->repl_head].amt);
+		__entry->usage		= ktime_to_ns(ss->usage);
+	),
+
+	TP_printk("pid=%d runtime=%Lu [ns] budget=%Ld [ns] usage=%Ld [ns]",
+			__entry->pid, (unsigned long long)__entry->runtime,
+			(long long)__entry->budget, (long long)__entry->usage)
+);
+
+/*
+ * Tracepoint for the budget controller changing the budget of a server:
+ */
+TRACE_EVENT(sched_ss_budget_adapt,
+
+	TP_PROTO(struct sched_ss_server *ss, s64 old_budget),
+
+	TP_ARGS(ss, old_budget),
+
+	TP_STRUCT__entry(
+		__field( pid_t,	pid			)
+		__field( s64,	old_budget		)
+		__field( s64,	new_budget		)
+		__field( u64,	avg_used		)
+		__field( unsigned int,	exh_rate	)
+	),
+
+	TP_fast_assign(
+		__entry->pid		= ss->task ? ss->task->pid : -1;
+		__entry->old_budget	= old_budget;
+		__entry->new_budget	= ktime_to_ns(ss->init_budget);
+		__entry->avg_used	= ss->ctl.avg_used;
+		__entry->exh_rate	= ss->ctl.exh_rate;
+	),
+
+	TP_printk("pid=%d old_budget=%Ld [ns] new_budget=%Ld [ns] avg_used=%Lu [ns] exh_rate=%u",
+			__entry->pid, (long long)__entry->old_budget,
+			(long long)__entry->new_budget,
+			(unsigned long long)__entry->avg_used,
+			__entry->exh_rate)
+);
+
+/*
+ * Tracepoint for a server switching between fg and bg priority:
+ */
+TRACE_EVENT(sched_ss_prio_change,
+
+	TP_PROTO(struct sched_ss_server *ss, int oldprio, int newprio),
+
+	TP_ARGS(ss, oldprio, newprio),
+
+	TP_STRUCT__entry(
+		__field( pid_t,	pid			)
+		__field( int,	oldprio			)
+		__field( int,	newprio			)
+		__field( s64,	budget			)
+		__field( s64,	usage			)
+	),
+
+	TP_fast_assign(
+		__entry->pid		= ss->task ? ss->task->pid : -1;
+		__entry->oldprio	= oldprio;
+		__entry->newprio	= newprio;
+		__entry->budget		= ktime_to_ns(ss->repl_list[ss->repl_head].amt);
+		__entry->usage		= ktime_to_ns(ss->usage);
+	),
+
+	TP_printk("pid=%d oldprio=%d newprio=%d budget=%Ld [ns] usage=%Ld [ns]",
+			__entry->pid, __entry->oldprio, __entry->newprio,
+			(long long)__entry->budget, (long long)__entry->usage)
+);
+
 #endif /* _TRACE_SCHED_H */
 
 /* This part must be outside protection */
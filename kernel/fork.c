@@ -193,6 +193,7 @@ void __put_task_struct(struct task_struct *tsk)
 
 	exit_creds(tsk);
 	delayacct_tsk_free(tsk);
+	sched_ss_free(tsk);
 	put_signal_struct(tsk->signal);
 
 	if (!profile_handoff_task(tsk))
@@ -1015,6 +1016,9 @@ static void rt_mutex_init_task(struct task_struct *p)
 #ifdef CONFIG_RT_MUTEXES
 	plist_head_init_raw(&p->pi_waiters, &p->pi_lock);
 	p->pi_blocked_on = NULL;
+	p->rt.ss_donor = NULL;
+	p->rt.ss_donor_debt = 0;
+	p->rt.ss_donor_exhausted = 0;
 #endif
 }
 
@@ -1209,7 +1213,9 @@ static struct task_struct *copy_process(unsigned long clone_flags,
 #endif
 
 	/* Perform scheduler related setup. Assign this task to a CPU. */
-	sched_fork(p);
+	retval = sched_fork(p);
+	if (retval)
+		goto bad_fork_cleanup_sched;
 
 	retval = perf_event_init_task(p);
 	if (retval)
@@ -1399,6 +1405,8 @@ bad_fork_cleanup_audit:
 	audit_free(p);
 bad_fork_cleanup_policy:
 	perf_event_free_task(p);
+bad_fork_cleanup_sched:
+	sched_ss_free(p);
 #ifdef CONFIG_NUMA
 	mpol_put(p->mempolicy);
 bad_fork_cleanup_cgroup:
@@ -720,6 +720,113 @@ static inline void
 irq_thread_check_affinity(struct irq_desc *desc, struct irqaction *action) { }
 #endif
 
+/*
+ * Run the interrupt thread under the server set for the irq, as a
+ * SCHED_SPORADIC polling server at the priority it would get as
+ * SCHED_FIFO.  It is suspended once the budget is used up.  The threads
+ * of a shared line split the budget evenly, which bounds the interference
+ * of an interrupt flood on the line to budget/period.
+ */
+static void irq_thread_set_server(struct irq_desc *desc)
+{
+	struct sched_param param = {
+		.sched_priority = MAX_USER_RT_PRIO/2,
+	};
+	struct irqaction *action;
+	unsigned int nr = 0;
+	u64 budget, period;
+
+	raw_spin_lock_irq(&desc->lock);
+	budget = desc->ss_budget;
+	period = desc->ss_period;
+	for (action = desc->action; action; action = action->next) {
+		if (action->thread)
+			nr++;
+	}
+	raw_spin_unlock_irq(&desc->lock);
+
+	if (nr > 1)
+		budget = div_u64(budget, nr);
+
+	if (budget) {
+		struct sched_param ss_param = param;
+
+		ss_param.sched_ss_low_priority = 1;
+		ss_param.sched_ss_repl_period = ns_to_timespec(period);
+		ss_param.sched_ss_init_budget = ns_to_timespec(budget);
+		ss_param.sched_ss_max_repl = 1;
+		ss_param.sched_ss_mode = SS_MODE_POLLING;
+		ss_param.sched_ss_bg_policy = SS_BG_SUSPEND;
+
+		if (!sched_setscheduler(current, SCHED_SPORADIC, &ss_param))
+			return;
+
+		printk(KERN_WARNING "%s: no bandwidth for a %llu/%llu ns server,"
+		       " running as SCHED_FIFO\n", current->comm,
+		       (unsigned long long)budget, (unsigned long long)period);
+	}
+
+	sched_setscheduler(current, SCHED_FIFO, &param);
+}
+
+/*
+ * Have the threads of desc adjust their server, with desc->lock held.
+ * Their share of the budget changes with their number, so this is also
+ * done when a threaded handler comes or goes.
+ */
+static void irq_set_thread_server_flags(struct irq_desc *desc)
+{
+	struct irqaction *action;
+
+	for (action = desc->action; action; action = action->next) {
+		if (action->thread)
+			set_bit(IRQTF_SERVER, &action->thread_flags);
+	}
+}
+
+/*
+ * Check whether we need to change the server of the interrupt thread.
+ */
+static void
+irq_thread_check_server(struct irq_desc *desc, struct irqaction *action)
+{
+	if (test_and_clear_bit(IRQTF_SERVER, &action->thread_flags))
+		irq_thread_set_server(desc);
+}
+
+/**
+ *	irq_set_thread_server - run the handler threads of an irq under a server
+ *	@irq:		Interrupt line
+ *	@budget:	Budget in ns, 0 to run the threads as plain SCHED_FIFO
+ *	@period:	Replenishment period in ns
+ *
+ *	The handler threads of the line are bound to SCHED_SPORADIC polling
+ *	servers which share @budget every @period, each getting an equal
+ *	part.  May be called before the irq is requested to set a default;
+ *	a running thread picks up the change the next time it handles an
+ *	interrupt, as for affinity changes.
+ */
+int irq_set_thread_server(unsigned int irq, u64 budget, u64 period)
+{
+	struct irq_desc *desc = irq_to_desc(irq);
+	unsigned long flags;
+
+	if (!desc)
+		return -EINVAL;
+
+	if (budget && (!period || budget > period))
+		return -EINVAL;
+
+	raw_spin_lock_irqsave(&desc->lock, flags);
+	desc->ss_budget = budget;
+	desc->ss_period = period;
+	irq_set_thread_server_flags(desc);
+	raw_spin_unlock_irqrestore(&desc->lock, flags);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(irq_set_thread_server);
+
 /*
  * Interrupts which are not explicitely requested as threaded
  * interrupts rely on the implicit bh/preempt disable of the hard irq
@@ -758,9 +865,6 @@ static irqreturn_t irq_thread_fn(struct irq_desc *desc,
  */
 static int irq_thread(void *data)
 {
-	static const struct sched_param param = {
-		.sched_priority = MAX_USER_RT_PRIO/2,
-	};
 	struct irqaction *action = data;
 	struct irq_desc *desc = irq_to_desc(action->irq);
 	irqreturn_t (*handler_fn)(struct irq_desc *desc,
@@ -773,12 +877,13 @@ static int irq_thread(void *data)
 	else
 		handler_fn = irq_thread_fn;
 
-	sched_setscheduler(current, SCHED_FIFO, &param);
+	irq_thread_set_server(desc);
 	current->irqaction = action;
 
 	while (!irq_wait_for_interrupt(action)) {
 
 		irq_thread_check_affinity(desc, action);
+		irq_thread_check_server(desc, action);
 
 		atomic_inc(&desc->threads_active);
 
@@ -1042,6 +1147,10 @@ __setup_irq(unsigned int irq, struct irq_desc *desc, struct irqaction *new)
 	new->irq = irq;
 	*old_ptr = new;
 
+	/* the threads of the line now share the budget with one more */
+	if (new->thread && desc->ss_budget)
+		irq_set_thread_server_flags(desc);
+
 	/* Reset broken irq detection when installing new handler */
 	desc->irq_count = 0;
 	desc->irqs_unhandled = 0;
@@ -1158,6 +1267,9 @@ static struct irqaction *__free_irq(unsigned int irq, void *dev_id)
 	/* Found it - now remove it from the list of entries: */
 	*action_ptr = action->next;
 
+	if (action->thread && desc->ss_budget)
+		irq_set_thread_server_flags(desc);
+
 	/* Currently used only by UML, might disappear one day: */
 #ifdef CONFIG_IRQ_RELEASE_METHOD
 	if (desc->irq_data.chip->release)
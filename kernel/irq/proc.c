@@ -12,6 +12,7 @@
 #include <linux/seq_file.h>
 #include <linux/interrupt.h>
 #include <linux/kernel_stat.h>
+#include <linux/uaccess.h>
 
 #include "internals.h"
 
@@ -266,6 +267,95 @@ static const struct file_operations irq_spurious_proc_fops = {
 	.release	= single_release,
 };
 
+static int irq_ss_budget_proc_show(struct seq_file *m, void *v)
+{
+	struct irq_desc *desc = irq_to_desc((long) m->private);
+
+	seq_printf(m, "%llu\n", div_u64(desc->ss_budget, NSEC_PER_USEC));
+	return 0;
+}
+
+static int irq_ss_period_proc_show(struct seq_file *m, void *v)
+{
+	struct irq_desc *desc = irq_to_desc((long) m->private);
+
+	seq_printf(m, "%llu\n", div_u64(desc->ss_period, NSEC_PER_USEC));
+	return 0;
+}
+
+/*
+ * ss_budget and ss_period set the server of the handler threads, in us.
+ * Setting the budget to 0 runs them as plain SCHED_FIFO again.
+ */
+static ssize_t write_irq_ss(struct file *file, const char __user *buffer,
+		size_t count, bool is_budget)
+{
+	unsigned int irq = (int)(long)PDE(file->f_path.dentry->d_inode)->data;
+	struct irq_desc *desc = irq_to_desc(irq);
+	u64 budget = desc->ss_budget, period = desc->ss_period;
+	unsigned long long val;
+	char buf[32];
+	int err;
+
+	if (count >= sizeof(buf))
+		return -EINVAL;
+	if (copy_from_user(buf, buffer, count))
+		return -EFAULT;
+	buf[count] = '\0';
+
+	err = kstrtoull(strstrip(buf), 10, &val);
+	if (err)
+		return err;
+	if (val > div_u64(ULLONG_MAX, NSEC_PER_USEC))
+		return -EINVAL;
+
+	if (is_budget)
+		budget = val * NSEC_PER_USEC;
+	else
+		period = val * NSEC_PER_USEC;
+
+	err = irq_set_thread_server(irq, budget, period);
+	return err ? err : count;
+}
+
+static ssize_t irq_ss_budget_proc_write(struct file *file,
+		const char __user *buffer, size_t count, loff_t *pos)
+{
+	return write_irq_ss(file, buffer, count, true);
+}
+
+static ssize_t irq_ss_period_proc_write(struct file *file,
+		const char __user *buffer, size_t count, loff_t *pos)
+{
+	return write_irq_ss(file, buffer, count, false);
+}
+
+static int irq_ss_budget_proc_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, irq_ss_budget_proc_show, PDE(inode)->data);
+}
+
+static int irq_ss_period_proc_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, irq_ss_period_proc_show, PDE(inode)->data);
+}
+
+static const struct file_operations irq_ss_budget_proc_fops = {
+	.open		= irq_ss_budget_proc_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+	.write		= irq_ss_budget_proc_write,
+};
+
+static const struct file_operations irq_ss_period_proc_fops = {
+	.open		= irq_ss_period_proc_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+	.write		= irq_ss_period_proc_write,
+};
+
 #define MAX_NAMELEN 128
 
 static int name_unique(unsigned int irq, struct irqaction *new_action)
@@ -341,6 +431,12 @@ void register_irq_proc(unsigned int irq, struct irq_desc *desc)
 
 	proc_create_data("spurious", 0444, desc->dir,
 			 &irq_spurious_proc_fops, (void *)(long)irq);
+
+	/* create /proc/irq/<irq>/ss_budget and ss_period */
+	proc_create_data("ss_budget", 0600, desc->dir,
+			 &irq_ss_budget_proc_fops, (void *)(long)irq);
+	proc_create_data("ss_period", 0600, desc->dir,
+			 &irq_ss_period_proc_fops, (void *)(long)irq);
 }
 
 void unregister_irq_proc(unsigned int irq, struct irq_desc *desc)
@@ -356,6 +452,8 @@ void unregister_irq_proc(unsigned int irq, struct irq_desc *desc)
 	remove_proc_entry("node", desc->dir);
 #endif
 	remove_proc_entry("spurious", desc->dir);
+	remove_proc_entry("ss_budget", desc->dir);
+	remove_proc_entry("ss_period", desc->dir);
 
 	memset(name, 0, MAX_NAMELEN);
 	sprintf(name, "%u", irq);
@@ -105,6 +105,29 @@ int rt_mutex_getprio(struct task_struct *task)
 		   task->normal_prio);
 }
 
+/*
+ * The SCHED_SPORADIC server a boosted task runs on: its top pi waiter,
+ * when that is a server in fg priority and the boost comes from it.
+ * Only direct waiters donate, a chain is not followed further down.
+ *
+ * task->pi_lock must be held.
+ */
+struct task_struct *rt_mutex_ss_donor(struct task_struct *task)
+{
+	struct rt_mutex_waiter *top;
+
+	if (likely(!task_has_pi_waiters(task)))
+		return NULL;
+
+	top = task_top_pi_waiter(task);
+	if (top->task->policy != SCHED_SPORADIC ||
+	    top->pi_list_entry.prio >= task->normal_prio ||
+	    top->task->normal_prio != MAX_RT_PRIO-1 - top->task->rt_priority)
+		return NULL;
+
+	return top->task;
+}
+
 /*
  * Adjust the priority of a task, after its pi_waiters got modified.
  *
@@ -114,7 +137,7 @@ static void __rt_mutex_adjust_prio(struct task_struct *task)
 {
 	int prio = rt_mutex_getprio(task);
 
-	if (task->prio != prio)
+	if (task->prio != prio || task->rt.ss_donor != rt_mutex_ss_donor(task))
 		rt_mutex_setprio(task, prio);
 }
 
@@ -71,6 +71,7 @@
 #include <linux/ctype.h>
 #include <linux/ftrace.h>
 #include <linux/slab.h>
+#include <linux/list_sort.h>
 
 #include <asm/tlb.h>
 #include <asm/irq_regs.h>
@@ -263,6 +264,8 @@ struct task_group {
 	struct rt_rq **rt_rq;
 
 	struct rt_bandwidth rt_bandwidth;
+	/* group server settings, user representation, off while 0 priority */
+	struct sched_param rt_ss_param;
 #endif
 
 	struct rcu_head rcu;
@@ -520,6 +523,8 @@ struct rq {
 	unsigned long avg_load_per_task;
 
 	u64 rt_avg;
+	/* part of rt_avg consumed under SCHED_SPORADIC servers */
+	u64 ss_avg;
 	u64 age_stamp;
 	u64 idle_stamp;
 	u64 avg_idle;
@@ -529,6 +534,31 @@ struct rq {
 	u64 prev_irq_time;
 #endif
 
+	/* SCHED_SPORADIC servers admitted on this cpu and their utilization */
+	struct list_head ss_list;
+	u64 ss_bw;
+	/* summed statistics of the SCHED_SPORADIC servers run on this cpu */
+	struct sched_ss_stats ss_stats;
+	/* replenishment timer queue of the SCHED_SPORADIC servers, see ss_tq_add() */
+	raw_spinlock_t ss_tq_lock;
+	struct timerqueue_head ss_tq;
+	struct hrtimer ss_timer;
+	/* enforces the budgets of the servers rq->curr runs under */
+	struct hrtimer ss_exh_timer;
+	/* average expiry latency of ss_exh_timer, it is armed this early */
+	s64 ss_exh_lat;
+#ifdef CONFIG_SMP
+	/* both timers are pinned, other cpus arm them through these */
+	int ss_tq_csd_pending;
+	struct call_single_data ss_tq_csd;
+	int ss_exh_csd_pending;
+	struct call_single_data ss_exh_csd;
+#endif
+	/* reclaimed budget, usable until ss_slack_expires, see ss_slack_give() */
+	u64 ss_slack;
+	ktime_t ss_slack_expires;
+	int ss_slack_prio;
+
 	/* calc_load related fields */
 	unsigned long calc_load_update;
 	long calc_load_active;
@@ -824,6 +854,20 @@ static __read_mostly int scheduler_running;
  */
 int sysctl_sched_rt_runtime = 950000;
 
+/*
+ * how long the SCHED_SPORADIC replenishment timer of a cpu may be delayed
+ * so that replenishments close together are handled in one expiry, in ns.
+ * default: 0
+ */
+unsigned int sysctl_sched_ss_timer_slack;
+
+/*
+ * placement of new SCHED_SPORADIC servers on a cpu:
+ * 0 - none, 1 - worst fit, 2 - first fit
+ * default: 0
+ */
+unsigned int sysctl_sched_ss_placement;
+
 static inline u64 global_rt_period(void)
 {
 	return (u64)sysctl_sched_rt_period * NSEC_PER_USEC;
@@ -837,6 +881,14 @@ static inline u64 global_rt_runtime(void)
 	return (u64)sysctl_sched_rt_runtime * NSEC_PER_USEC;
 }
 
+static unsigned long to_ratio(u64 period, u64 runtime)
+{
+	if (runtime == RUNTIME_INF)
+		return 1ULL << 20;
+
+	return div64_u64(runtime << 20, period);
+}
+
 #ifndef prepare_arch_switch
 # define prepare_arch_switch(next)	do { } while (0)
 #endif
@@ -1284,6 +1336,7 @@ static void sched_avg_update(struct rq *rq)
 		asm("" : "+rm" (rq->age_stamp));
 		rq->age_stamp += period;
 		rq->rt_avg /= 2;
+		rq->ss_avg /= 2;
 	}
 }
 
@@ -1293,6 +1346,11 @@ static void sched_rt_avg_update(struct rq *rq, u64 rt_delta)
 	sched_avg_update(rq);
 }
 
+static void sched_ss_avg_update(struct rq *rq, u64 ss_delta)
+{
+	rq->ss_avg += ss_delta;
+}
+
 #else /* !CONFIG_SMP */
 static void resched_task(struct task_struct *p)
 {
@@ -1304,6 +1362,10 @@ static void sched_rt_avg_update(struct rq *rq, u64 rt_delta)
 {
 }
 
+static void sched_ss_avg_update(struct rq *rq, u64 ss_delta)
+{
+}
+
 static void sched_avg_update(struct rq *rq)
 {
 }
@@ -1773,6 +1835,8 @@ static inline void __set_task_cpu(struct task_struct *p, unsigned int cpu)
 
 static const struct sched_class rt_sched_class;
 
+static void ss_enqueue_task(struct rq *rq, struct task_struct *p, int flags);
+
 #define sched_class_highest (&stop_sched_class)
 #define for_each_class(class) \
    for (class = sched_class_highest; class; class = class->next)
@@ -1811,6 +1875,8 @@ static void enqueue_task(struct rq *rq, struct task_struct *p, int flags)
 {
 	update_rq_clock(rq);
 	sched_info_queued(p);
+	if (p->policy == SCHED_SPORADIC)
+		ss_enqueue_task(rq, p, flags);
 	p->sched_class->enqueue_task(rq, p, flags);
 }
 
@@ -2221,6 +2287,7 @@ void set_task_cpu(struct task_struct *p, unsigned int new_cpu)
 	if (task_cpu(p) != new_cpu) {
 		p->se.nr_migrations++;
 		perf_sw_event(PERF_COUNT_SW_CPU_MIGRATIONS, 1, 1, NULL, 0);
+		ss_migrate_task(p, new_cpu);
 	}
 
 	__set_task_cpu(p, new_cpu);
@@ -2822,10 +2889,42 @@ static void __sched_fork(struct task_struct *p)
 /*
  * fork()/clone()-time setup:
  */
-void sched_fork(struct task_struct *p)
+int sched_fork(struct task_struct *p)
 {
 	unsigned long flags;
-	int cpu = get_cpu();
+	int cpu;
+
+	/*
+	 * A SCHED_SPORADIC child gets a server of its own, starting with a
+	 * full budget.  It is allocated from the parent's parameters before
+	 * we pin the cpu, since that may sleep.
+	 */
+	p->rt.ss = NULL;
+	p->rt.ss_status = NULL;
+	if (p->policy == SCHED_SPORADIC && !p->sched_reset_on_fork) {
+		struct sched_ss_server *ss;
+		struct sched_param param;
+
+		rcu_read_lock();
+		ss = current->rt.ss;
+		if (ss)
+			ss_get_param(ss, &param);
+		rcu_read_unlock();
+
+		/* the parent left SCHED_SPORADIC while forking */
+		if (!ss)
+			return -EAGAIN;
+
+		p->rt.ss = ss_alloc_server(p, &param);
+		if (!p->rt.ss)
+			return -ENOMEM;
+
+		/* the child reserves a budget of its own */
+		if (ss_bw_admit(p->rt.ss, &p->cpus_allowed, NULL))
+			return -EBUSY;
+	}
+
+	cpu = get_cpu();
 
 	__sched_fork(p);
 	/*
@@ -2862,6 +2961,11 @@ void sched_fork(struct task_struct *p)
 	 */
 	p->prio = current->normal_prio;
 
+	if (p->rt.ss) {
+		ss_init_server(p, ss_get_now(p));
+		p->prio = p->normal_prio;
+	}
+
 	if (!rt_prio(p->prio))
 		p->sched_class = &fair_sched_class;
 
@@ -2895,6 +2999,57 @@ void sched_fork(struct task_struct *p)
 #endif
 
 	put_cpu();
+
+	return 0;
+}
+
+/*
+ * Free the SCHED_SPORADIC server of a task that is going away, or of a
+ * child whose fork failed.
+ */
+void sched_ss_free(struct task_struct *p)
+{
+	ss_free_server(p->rt.ss);
+	p->rt.ss = NULL;
+
+	/* mappings of the status page hold references of their own */
+	if (p->rt.ss_status) {
+		free_page((unsigned long)p->rt.ss_status);
+		p->rt.ss_status = NULL;
+	}
+}
+
+/*
+ * The status page of p, see __ss_status_update().  It is allocated when
+ * first asked for and freed with the task.
+ *
+ * @return: the page, or NULL when out of memory.
+ */
+struct page *sched_ss_status_page(struct task_struct *p)
+{
+	struct sched_ss_status *st;
+	unsigned long flags;
+	struct rq *rq;
+
+	if (p->rt.ss_status)
+		return virt_to_page(p->rt.ss_status);
+
+	st = (struct sched_ss_status *)get_zeroed_page(GFP_KERNEL);
+	if (!st)
+		return NULL;
+
+	rq = task_rq_lock(p, &flags);
+	if (!p->rt.ss_status) {
+		p->rt.ss_status = st;
+		ss_status_update(p);
+		st = NULL;
+	}
+	task_rq_unlock(rq, p, &flags);
+
+	if (st)
+		free_page((unsigned long)st);
+
+	return virt_to_page(p->rt.ss_status);
 }
 
 /*
@@ -3068,6 +3223,7 @@ static void finish_task_switch(struct rq *rq, struct task_struct *prev)
 		 * task and put them back on the free list.
 		 */
 		kprobe_flush_task(prev);
+		ss_task_dead(prev);
 		put_task_struct(prev);
 	}
 }
@@ -4329,6 +4485,8 @@ need_resched:
 
 	post_schedule(rq);
 
+	ss_pi_schedule(current);
+
 	preempt_enable_no_resched();
 	if (need_resched())
 		goto need_resched;
@@ -4843,6 +5001,7 @@ EXPORT_SYMBOL(sleep_on_timeout);
 void rt_mutex_setprio(struct task_struct *p, int prio)
 {
 	int oldprio, on_rq, running;
+	struct task_struct *old_donor;
 	struct rq *rq;
 	const struct sched_class *prev_class;
 
@@ -4850,6 +5009,10 @@ void rt_mutex_setprio(struct task_struct *p, int prio)
 
 	rq = __task_rq_lock(p);
 
+	old_donor = ss_pi_set_donor(rq, p, rt_mutex_ss_donor(p));
+	if (p->prio == prio)
+		goto out_unlock;
+
 	trace_sched_pi_setprio(p, prio);
 	oldprio = p->prio;
 	prev_class = p->sched_class;
@@ -4873,7 +5036,11 @@ void rt_mutex_setprio(struct task_struct *p, int prio)
 		enqueue_task(rq, p, oldprio < prio ? ENQUEUE_HEAD : 0);
 
 	check_class_changed(rq, p, prev_class, oldprio);
+out_unlock:
 	__task_rq_unlock(rq);
+
+	if (old_donor)
+		put_task_struct(old_donor);
 }
 
 #endif
@@ -5072,8 +5239,10 @@ static int __sched_setscheduler(struct task_struct *p, int policy,
 	int retval, oldprio, oldpolicy = -1, on_rq, running;
 	unsigned long flags;
 	const struct sched_class *prev_class;
+	struct sched_ss_server *ss = NULL, *old_ss = NULL;
 	struct rq *rq;
 	int reset_on_fork;
+	int place_cpu = -1;
 
 	/* may grab non-irq protected spin_locks */
 	BUG_ON(in_interrupt());
@@ -5113,9 +5282,49 @@ recheck:
 	if (policy == SCHED_SPORADIC && param->sched_ss_low_priority < 1)
 		return -EINVAL;
 
-	if (policy == SCHED_SPORADIC && param->sched_ss_max_repl > SS_REPL_MAX)
+	if (policy == SCHED_SPORADIC &&
+	    (param->sched_ss_max_repl < 1 || param->sched_ss_max_repl > SS_REPL_MAX))
 		return -EINVAL;
 
+	/*
+	 * The fg priority must be above the low priority, and the budget must
+	 * fit in the replenishment period.
+	 */
+	if (policy == SCHED_SPORADIC) {
+		s64 budget = timespec_to_ns(&param->sched_ss_init_budget);
+		s64 period = timespec_to_ns(&param->sched_ss_repl_period);
+
+		if (param->sched_ss_low_priority >= param->sched_priority)
+			return -EINVAL;
+		if (budget <= 0 || budget > period)
+			return -EINVAL;
+		if (param->sched_ss_mode != SS_MODE_SPORADIC &&
+		    param->sched_ss_mode != SS_MODE_POLLING &&
+		    param->sched_ss_mode != SS_MODE_DEFERRABLE)
+			return -EINVAL;
+		if (param->sched_ss_bg_policy != SS_BG_SUSPEND &&
+		    param->sched_ss_bg_policy != SS_BG_RT &&
+		    param->sched_ss_bg_policy != SS_BG_FAIR)
+			return -EINVAL;
+	}
+
+	/*
+	 * An adapted budget needs period boundaries to be measured at, and
+	 * bounds around the initial budget that fit in the period.
+	 */
+	if (policy == SCHED_SPORADIC &&
+	    timespec_to_ns(&param->sched_ss_max_budget)) {
+		s64 budget = timespec_to_ns(&param->sched_ss_init_budget);
+		s64 period = timespec_to_ns(&param->sched_ss_repl_period);
+		s64 min = timespec_to_ns(&param->sched_ss_min_budget);
+		s64 max = timespec_to_ns(&param->sched_ss_max_budget);
+
+		if (param->sched_ss_mode == SS_MODE_SPORADIC)
+			return -EINVAL;
+		if (min <= 0 || min > budget || budget > max || max > period)
+			return -EINVAL;
+	}
+
 	/* real-time priority must be > 0, non-real-time priority must be 0 */
 
 	if (rt_policy(policy) != (param->sched_priority != 0))
@@ -5163,6 +5372,16 @@ recheck:
 			return retval;
 	}
 
+	/*
+	 * The new server is allocated here since that may sleep.  It is only
+	 * visible once installed under rq->lock below.
+	 */
+	if (policy == SCHED_SPORADIC) {
+		ss = ss_alloc_server(p, param);
+		if (!ss)
+			return -ENOMEM;
+	}
+
 	/*
 	 * make sure no PI-waiters arrive (or leave) while we are
 	 * changing the priority of the task:
@@ -5177,25 +5396,27 @@ recheck:
 	 */
 	if (p == rq->stop) {
 		task_rq_unlock(rq, p, &flags);
+		ss_free_server(ss);
 		return -EINVAL;
 	}
 
-/*
- * TODO: When adding SCHED_SPORADIC, more in depth check needed to
- * determine if no scheduling parameters are changed.
- */
-#if 0
 	/*
-	 * If not changing anything there's no need to proceed further:
+	 * If not changing anything there's no need to proceed further.  A
+	 * SCHED_SPORADIC task that only gets a new budget or period keeps its
+	 * server, see ss_retune().
 	 */
-	if (unlikely(policy == p->policy && (!rt_policy(policy) ||
-			param->sched_priority == p->rt_priority))) {
-
-		__task_rq_unlock(rq);
-		raw_spin_unlock_irqrestore(&p->pi_lock, flags);
-		return 0;
+	if (unlikely(policy == p->policy &&
+		     reset_on_fork == p->sched_reset_on_fork &&
+		     (!rt_policy(policy) ||
+		      param->sched_priority == p->rt_priority))) {
+		retval = 0;
+		if (policy != SCHED_SPORADIC || ss_param_equal(p->rt.ss, ss))
+			goto out_unchanged;
+		if (ss_can_retune(p->rt.ss, ss)) {
+			retval = ss_retune(p, ss);
+			goto out_unchanged;
+		}
 	}
-#endif
 
 #ifdef CONFIG_RT_GROUP_SCHED
 	if (user) {
@@ -5207,6 +5428,7 @@ recheck:
 				task_group(p)->rt_bandwidth.rt_runtime == 0 &&
 				!task_group_is_autogroup(task_group(p))) {
 			task_rq_unlock(rq, p, &flags);
+			ss_free_server(ss);
 			return -EPERM;
 		}
 	}
@@ -5216,8 +5438,20 @@ recheck:
 	if (unlikely(oldpolicy != -1 && oldpolicy != p->policy)) {
 		policy = oldpolicy = -1;
 		task_rq_unlock(rq, p, &flags);
+		ss_free_server(ss);
+		ss = NULL;
 		goto recheck;
 	}
+
+	/* the new server has to fit next to the ones already admitted */
+	if (ss && ss_bw_admit_task(ss, p, p->rt.ss)) {
+		task_rq_unlock(rq, p, &flags);
+		ss_free_server(ss);
+		return -EBUSY;
+	}
+	if (ss && ss->placed)
+		place_cpu = ss->bw_cpu;
+
 	on_rq = p->on_rq;
 	running = task_current(rq, p);
 	if (on_rq)
@@ -5229,49 +5463,33 @@ recheck:
 
 	oldprio = p->prio;
 	prev_class = p->sched_class;
+
+	/*
+	 * Pending replenishments of the old server are dropped.  It is freed
+	 * once rq->lock is released, its timers can't be waited for here.
+	 */
+	if (p->rt.ss) {
+		ss_stop_server(p);
+		old_ss = p->rt.ss;
+	}
+	p->rt.ss = ss;
+
 	__setscheduler(rq, p, policy, param->sched_priority);
 
 	/* Initialization of SCHED_SPORADIC task parameters */
 	if (policy == SCHED_SPORADIC) {
-		ktime_t now;
-
 		/* when first starting, rt_priority will be the fg priority, which is
 		 * is set above through __setscheduler(). */
 
-		/* for polling server start with bg prio and increase to fg when repl
-		 * arrives */
-		p->normal_prio = MAX_RT_PRIO-1 - param->sched_ss_low_priority;
-		/* we are holding p->pi_lock already */
-		p->prio = rt_mutex_getprio(p);
-
-		/* put priority into kernel's representation */
-		p->sched_ss_low_priority = MAX_RT_PRIO-1 - param->sched_ss_low_priority;
-		p->sched_ss_repl_period = timespec_to_ktime(param->sched_ss_repl_period);
-		p->sched_ss_init_budget = timespec_to_ktime(param->sched_ss_init_budget);
-		p->sched_ss_max_repl = param->sched_ss_max_repl;
-
-		/* initialize timers */
-		hrtimer_init(&p->ss_repl_timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
-		p->ss_repl_timer.function = ss_repl_cb;
-
-		hrtimer_init(&p->ss_exh_timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
-		p->ss_exh_timer.function = ss_exh_cb;
-
-		/* initialize ss_repl_list */
-		p->ss_repl_list[0].amt = p->sched_ss_init_budget;
-		p->ss_repl_list[0].time = hrtimer_cb_get_time(&p->ss_repl_timer);
-		p->repl_head = 0;
-
-		p->ss_usage = ns_to_ktime(0);
-
 		/*
-		 * Set the start time of the first period.
-		 * fg execution will begin start of second period.
-		 * Timer is NOT activated here.
+		 * Start with the full budget in bg prio, the enqueue below (or
+		 * the next wakeup) raises p to fg.
 		 */
-		now = hrtimer_cb_get_time(&p->ss_repl_timer);
-		hrtimer_set_expires(&p->ss_repl_timer, now);
+		ss_init_server(p, ss_get_now(p));
+		/* we are holding p->pi_lock already */
+		p->prio = rt_mutex_getprio(p);
 	}
+	ss_status_update(p);
 
 	if (running)
 		p->sched_class->set_curr_task(rq);
@@ -5285,9 +5503,26 @@ recheck:
 	check_class_changed(rq, p, prev_class, oldprio);
 	task_rq_unlock(rq, p, &flags);
 
+	/*
+	 * The placement policy picked a cpu for the new server, or p gets
+	 * back the cpus it allowed itself before its old server was placed.
+	 */
+	if (place_cpu >= 0)
+		set_cpus_allowed_ptr(p, cpumask_of(place_cpu));
+	else if (old_ss && old_ss->placed)
+		set_cpus_allowed_ptr(p, &old_ss->place_mask);
+
+	ss_free_server(old_ss);
+
 	rt_mutex_adjust_pi(p);
 
 	return 0;
+
+out_unchanged:
+	task_rq_unlock(rq, p, &flags);
+	ss_free_server(ss);
+
+	return retval;
 }
 
 /**
@@ -5424,12 +5659,11 @@ SYSCALL_DEFINE2(sched_getparam, pid_t, pid, struct sched_param __user *, param)
 	/* if scheduling policy (p->policy) is SCHED_SPORADIC, set other
 	 * members of returning struct sched_param */
 	if (p->policy == SCHED_SPORADIC) {
-		lp.sched_priority = p->rt_priority;
-		/* p->sched_ss_low_priority is in kernel representation, convert to user representation */
-		lp.sched_ss_low_priority = MAX_RT_PRIO-1 - p->sched_ss_low_priority;
-		lp.sched_ss_repl_period = ktime_to_timespec(p->sched_ss_repl_period);
-		lp.sched_ss_init_budget = ktime_to_timespec(p->sched_ss_init_budget);
-		lp.sched_ss_max_repl = p->sched_ss_max_repl;
+		/* the server is freed after a grace period, see ss_free_server() */
+		struct sched_ss_server *ss = ACCESS_ONCE(p->rt.ss);
+
+		if (ss)
+			ss_get_param(ss, &lp);
 	}
 
 	rcu_read_unlock();
@@ -5449,6 +5683,7 @@ out_unlock:
 long sched_setaffinity(pid_t pid, const struct cpumask *in_mask)
 {
 	cpumask_var_t cpus_allowed, new_mask;
+	struct ss_bw_saved ss_saved;
 	struct task_struct *p;
 	int retval;
 
@@ -5485,7 +5720,14 @@ long sched_setaffinity(pid_t pid, const struct cpumask *in_mask)
 	cpuset_cpus_allowed(p, cpus_allowed);
 	cpumask_and(new_mask, in_mask, cpus_allowed);
 again:
+	/* a SCHED_SPORADIC server has to fit on its new cpus as well */
+	retval = ss_bw_setaffinity(p, new_mask, &ss_saved);
+	if (retval)
+		goto out_unlock;
+
 	retval = set_cpus_allowed_ptr(p, new_mask);
+	if (retval)
+		ss_bw_setaffinity_undo(p, &ss_saved);
 
 	if (!retval) {
 		cpuset_cpus_allowed(p, cpus_allowed);
@@ -5632,6 +5874,35 @@ SYSCALL_DEFINE0(sched_yield)
 	return 0;
 }
 
+/**
+ * sys_sched_ss_complete - the calling SCHED_SPORADIC task completed a job.
+ *
+ * The caller drops to its bg priority right away rather than when its
+ * budget runs out, leaving the rest of it to other tasks until its next
+ * replenishment.  Its reservation is unchanged.  The execution time of
+ * the job, since the previous call, goes into the server statistics.
+ *
+ * Return: 0, or -EINVAL if the caller is not SCHED_SPORADIC.
+ */
+SYSCALL_DEFINE0(sched_ss_complete)
+{
+	struct task_struct *p = current;
+	unsigned long flags;
+	struct rq *rq;
+	int retval = -EINVAL;
+
+	rq = task_rq_lock(p, &flags);
+	if (p->policy == SCHED_SPORADIC) {
+		update_rq_clock(rq);
+		ss_job_complete(rq, p,
+				p->se.sum_exec_runtime + do_task_delta_exec(p, rq));
+		retval = 0;
+	}
+	task_rq_unlock(rq, p, &flags);
+
+	return retval;
+}
+
 static inline int should_resched(void)
 {
 	return need_resched() && !(preempt_count() & PREEMPT_ACTIVE);
@@ -8183,6 +8454,8 @@ void __init sched_init(void)
 #endif /* CONFIG_FAIR_GROUP_SCHED */
 
 		rq->rt.rt_runtime = def_rt_bandwidth.rt_runtime;
+		INIT_LIST_HEAD(&rq->ss_list);
+		init_ss_rq(rq);
 #ifdef CONFIG_RT_GROUP_SCHED
 		INIT_LIST_HEAD(&rq->leaf_rt_rq_list);
 		init_tg_rt_entry(&root_task_group, &rq->rt, NULL, i, NULL);
@@ -8252,6 +8525,8 @@ void __init sched_init(void)
 
 	/* Allocate the nohz_cpu_mask if CONFIG_CPUMASK_OFFSTACK */
 	zalloc_cpumask_var(&nohz_cpu_mask, GFP_NOWAIT);
+
+	ss_server_cachep = KMEM_CACHE(sched_ss_server, SLAB_PANIC);
 #ifdef CONFIG_SMP
 	zalloc_cpumask_var(&sched_domains_tmpmask, GFP_NOWAIT);
 #ifdef CONFIG_NO_HZ
@@ -8511,6 +8786,9 @@ static void free_rt_sched_group(struct task_group *tg)
 	destroy_rt_bandwidth(&tg->rt_bandwidth);
 
 	for_each_possible_cpu(i) {
+		/* the server still refers to the rt_rq */
+		if (tg->rt_se && tg->rt_se[i])
+			ss_free_server(tg->rt_se[i]->ss);
 		if (tg->rt_rq)
 			kfree(tg->rt_rq[i]);
 		if (tg->rt_se)
@@ -8726,14 +9004,6 @@ unsigned long sched_group_shares(struct task_group *tg)
  */
 static DEFINE_MUTEX(rt_constraints_mutex);
 
-static unsigned long to_ratio(u64 period, u64 runtime)
-{
-	if (runtime == RUNTIME_INF)
-		return 1ULL << 20;
-
-	return div64_u64(runtime << 20, period);
-}
-
 /* Must be called with tasklist_lock held */
 static inline int tg_has_rt_tasks(struct task_group *tg)
 {
@@ -8896,6 +9166,147 @@ long sched_group_rt_period(struct task_group *tg)
 	return rt_period_us;
 }
 
+enum {
+	RT_SS_PRIORITY,
+	RT_SS_LOW_PRIORITY,
+	RT_SS_BUDGET,
+	RT_SS_PERIOD,
+	RT_SS_MAX_REPL,
+	RT_SS_MODE,
+};
+
+/*
+ * Replace the group servers of tg with ones using @param, or remove them
+ * when the priority is 0.  The servers restart with a full budget.
+ */
+static int tg_set_rt_ss(struct task_group *tg, const struct sched_param *param)
+{
+	struct sched_ss_server **ss;
+	int i, err = 0;
+
+	if (!param->sched_priority && !tg->rt_ss_param.sched_priority)
+		return 0;
+
+	if (param->sched_priority) {
+		s64 budget = timespec_to_ns(&param->sched_ss_init_budget);
+		s64 period = timespec_to_ns(&param->sched_ss_repl_period);
+
+		if (param->sched_priority > MAX_USER_RT_PRIO-1 ||
+		    param->sched_ss_low_priority < 1 ||
+		    param->sched_ss_low_priority >= param->sched_priority)
+			return -EINVAL;
+		if (param->sched_ss_max_repl < 1 ||
+		    param->sched_ss_max_repl > SS_REPL_MAX)
+			return -EINVAL;
+		if (budget <= 0 || budget > period)
+			return -EINVAL;
+		if (param->sched_ss_mode != SS_MODE_SPORADIC &&
+		    param->sched_ss_mode != SS_MODE_POLLING &&
+		    param->sched_ss_mode != SS_MODE_DEFERRABLE)
+			return -EINVAL;
+		/* a group in bg is throttled */
+		if (param->sched_ss_bg_policy != SS_BG_SUSPEND)
+			return -EINVAL;
+	}
+
+	ss = kcalloc(nr_cpu_ids, sizeof(*ss), GFP_KERNEL);
+	if (!ss)
+		return -ENOMEM;
+
+	if (param->sched_priority) {
+		for_each_possible_cpu(i) {
+			ss[i] = ss_alloc_server(NULL, param);
+			if (!ss[i]) {
+				err = -ENOMEM;
+				goto out;
+			}
+			/* the old server keeps its share until it is freed */
+			if (ss_bw_admit(ss[i], cpumask_of(i), tg->rt_se[i]->ss)) {
+				err = -EBUSY;
+				goto out;
+			}
+		}
+	}
+
+	for_each_possible_cpu(i) {
+		struct rq *rq = cpu_rq(i);
+
+		raw_spin_lock_irq(&rq->lock);
+		ss[i] = ss_group_set_server(tg, i, ss[i]);
+		raw_spin_unlock_irq(&rq->lock);
+	}
+out:
+	for_each_possible_cpu(i)
+		ss_free_server(ss[i]);
+	kfree(ss);
+
+	return err;
+}
+
+static int sched_group_set_rt_ss(struct task_group *tg, int attr, u64 val)
+{
+	struct sched_param param;
+	int err;
+
+	if (tg == &root_task_group)
+		return -EINVAL;
+	if (val > INT_MAX)
+		return -EINVAL;
+
+	mutex_lock(&rt_constraints_mutex);
+	param = tg->rt_ss_param;
+
+	switch (attr) {
+	case RT_SS_PRIORITY:
+		param.sched_priority = val;
+		break;
+	case RT_SS_LOW_PRIORITY:
+		param.sched_ss_low_priority = val;
+		break;
+	case RT_SS_BUDGET:
+		param.sched_ss_init_budget = ns_to_timespec(val * NSEC_PER_USEC);
+		break;
+	case RT_SS_PERIOD:
+		param.sched_ss_repl_period = ns_to_timespec(val * NSEC_PER_USEC);
+		break;
+	case RT_SS_MAX_REPL:
+		param.sched_ss_max_repl = val;
+		break;
+	case RT_SS_MODE:
+		param.sched_ss_mode = val;
+		break;
+	}
+
+	err = tg_set_rt_ss(tg, &param);
+	if (!err)
+		tg->rt_ss_param = param;
+	mutex_unlock(&rt_constraints_mutex);
+
+	return err;
+}
+
+static u64 sched_group_rt_ss(struct task_group *tg, int attr)
+{
+	struct sched_param *param = &tg->rt_ss_param;
+
+	switch (attr) {
+	case RT_SS_PRIORITY:
+		return param->sched_priority;
+	case RT_SS_LOW_PRIORITY:
+		return param->sched_ss_low_priority;
+	case RT_SS_BUDGET:
+		return div_u64(timespec_to_ns(&param->sched_ss_init_budget), NSEC_PER_USEC);
+	case RT_SS_PERIOD:
+		return div_u64(timespec_to_ns(&param->sched_ss_repl_period), NSEC_PER_USEC);
+	case RT_SS_MAX_REPL:
+		return param->sched_ss_max_repl;
+	case RT_SS_MODE:
+		return param->sched_ss_mode;
+	}
+
+	return 0;
+}
+
 static int sched_rt_global_constraints(void)
 {
 	u64 runtime, period;
@@ -9098,6 +9509,17 @@ static u64 cpu_rt_period_read_uint(struct cgroup *cgrp, struct cftype *cft)
 {
 	return sched_group_rt_period(cgroup_tg(cgrp));
 }
+
+static int cpu_rt_ss_write_u64(struct cgroup *cgrp, struct cftype *cft,
+		u64 val)
+{
+	return sched_group_set_rt_ss(cgroup_tg(cgrp), cft->private, val);
+}
+
+static u64 cpu_rt_ss_read_u64(struct cgroup *cgrp, struct cftype *cft)
+{
+	return sched_group_rt_ss(cgroup_tg(cgrp), cft->private);
+}
 #endif /* CONFIG_RT_GROUP_SCHED */
 
 static struct cftype cpu_files[] = {
@@ -9119,6 +9541,42 @@ static struct cftype cpu_files[] = {
 		.read_u64 = cpu_rt_period_read_uint,
 		.write_u64 = cpu_rt_period_write_uint,
 	},
+	{
+		.name = "rt_ss_priority",
+		.read_u64 = cpu_rt_ss_read_u64,
+		.write_u64 = cpu_rt_ss_write_u64,
+		.private = RT_SS_PRIORITY,
+	},
+	{
+		.name = "rt_ss_low_priority",
+		.read_u64 = cpu_rt_ss_read_u64,
+		.write_u64 = cpu_rt_ss_write_u64,
+		.private = RT_SS_LOW_PRIORITY,
+	},
+	{
+		.name = "rt_ss_budget_us",
+		.read_u64 = cpu_rt_ss_read_u64,
+		.write_u64 = cpu_rt_ss_write_u64,
+		.private = RT_SS_BUDGET,
+	},
+	{
+		.name = "rt_ss_period_us",
+		.read_u64 = cpu_rt_ss_read_u64,
+		.write_u64 = cpu_rt_ss_write_u64,
+		.private = RT_SS_PERIOD,
+	},
+	{
+		.name = "rt_ss_max_repl",
+		.read_u64 = cpu_rt_ss_read_u64,
+		.write_u64 = cpu_rt_ss_write_u64,
+		.private = RT_SS_MAX_REPL,
+	},
+	{
+		.name = "rt_ss_mode",
+		.read_u64 = cpu_rt_ss_read_u64,
+		.write_u64 = cpu_rt_ss_write_u64,
+		.private = RT_SS_MODE,
+	},
 #endif
 };
 
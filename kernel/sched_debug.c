@@ -218,8 +218,113 @@ void print_cfs_rq(struct seq_file *m, int cpu, struct cfs_rq *cfs_rq)
 #endif
 }
 
+static void print_ss_lat_hist(struct seq_file *m, struct sched_ss_stats *st,
+			      const char *fmt)
+{
+	char name[32];
+	int i;
+
+	for (i = 0; i < SS_LAT_BUCKETS; i++) {
+		if (!st->lat_hist[i])
+			continue;
+		if (i == SS_LAT_BUCKETS - 1)
+			snprintf(name, sizeof(name), "ss.wakeup_fg_lat>=%dus", 1 << (i - 1));
+		else
+			snprintf(name, sizeof(name), "ss.wakeup_fg_lat<%dus", 1 << i);
+		SEQ_printf(m, fmt, name, (long long)st->lat_hist[i]);
+	}
+}
+
+/* statistics of the SCHED_SPORADIC servers run on a cpu, or of a group server */
+static void print_ss_stats(struct seq_file *m, struct sched_ss_stats *st)
+{
+#define P(x) \
+	SEQ_printf(m, "  .%-30s: %Ld\n", "ss." #x, (long long)(st->x))
+#define PN(x) \
+	SEQ_printf(m, "  .%-30s: %Ld.%06ld\n", "ss." #x, SPLIT_NS(st->x))
+
+	P(nr_repl);
+	P(nr_exhaust);
+	P(nr_overrun);
+	PN(overrun_max);
+	PN(overrun_sum);
+	P(nr_period_skip);
+	P(nr_nobudget);
+	PN(fg_runtime);
+	PN(bg_runtime);
+	PN(pi_runtime);
+	PN(slack_given);
+	PN(slack_drawn);
+	P(nr_jobs);
+	PN(job_runtime_sum);
+	PN(job_runtime_max);
+	print_ss_lat_hist(m, st, "  .%-30s: %Ld\n");
+
+#undef PN
+#undef P
+}
+
+/*
+ * Per task server statistics.  budget_used is the fg runtime in permille
+ * of the budget made available in the periods since the server started.
+ */
+static void print_task_ss_stats(struct seq_file *m, struct sched_ss_server *ss)
+{
+	struct sched_ss_stats *st = &ss->stats;
+	u64 elapsed, available;
+
+#define P(x) \
+	SEQ_printf(m, "%-35s:%21Ld\n", "ss." #x, (long long)st->x)
+#define PN(x) \
+	SEQ_printf(m, "%-35s:%14Ld.%06ld\n", "ss." #x, SPLIT_NS((long long)st->x))
+
+	P(nr_repl);
+	P(nr_exhaust);
+	P(nr_overrun);
+	PN(overrun_max);
+	PN(overrun_sum);
+	P(nr_period_skip);
+	P(nr_nobudget);
+	PN(fg_runtime);
+	PN(bg_runtime);
+	PN(pi_runtime);
+	PN(slack_given);
+	PN(slack_drawn);
+	P(nr_jobs);
+	PN(job_runtime_sum);
+	PN(job_runtime_max);
+
+	elapsed = ktime_to_ns(ktime_sub(ktime_get(), ss->start));
+	available = div64_u64(elapsed, ktime_to_ns(ss->repl_period)) *
+		    ktime_to_ns(ss->init_budget);
+	SEQ_printf(m, "%-35s:%21Ld\n", "ss.budget_used",
+		   available ? (long long)div64_u64(st->fg_runtime * 1000,
+						    available) : 0LL);
+
+	print_ss_lat_hist(m, st, "%-35s:%21Ld\n");
+
+	/* the budget controller, if any: init_budget is where it is now */
+	if (ss->ctl.max_budget.tv64) {
+		SEQ_printf(m, "%-35s:%14Ld.%06ld\n", "ss.ctl.budget",
+			   SPLIT_NS(ktime_to_ns(ss->init_budget)));
+		SEQ_printf(m, "%-35s:%14Ld.%06ld\n", "ss.ctl.avg_used",
+			   SPLIT_NS((long long)ss->ctl.avg_used));
+		SEQ_printf(m, "%-35s:%21Ld\n", "ss.ctl.exh_rate",
+			   (long long)ss->ctl.exh_rate);
+		SEQ_printf(m, "%-35s:%21Ld\n", "ss.ctl.nr_adjust",
+			   (long long)ss->ctl.nr_adjust);
+		SEQ_printf(m, "%-35s:%21Ld\n", "ss.ctl.nr_denied",
+			   (long long)ss->ctl.nr_denied);
+	}
+
+#undef PN
+#undef P
+}
+
 void print_rt_rq(struct seq_file *m, int cpu, struct rt_rq *rt_rq)
 {
+	struct sched_ss_server *ss;
+
 #ifdef CONFIG_RT_GROUP_SCHED
 	SEQ_printf(m, "\nrt_rq[%d]:%s\n", cpu, task_group_path(rt_rq->tg));
 #else
@@ -238,6 +343,10 @@ void print_rt_rq(struct seq_file *m, int cpu, struct rt_rq *rt_rq)
 
 #undef PN
 #undef P
+
+	ss = rt_rq_ss(rt_rq);
+	if (ss)
+		print_ss_stats(m, &ss->stats);
 }
 
 extern __read_mostly int sched_clock_running;
@@ -303,6 +412,9 @@ static void print_cpu(struct seq_file *m, int cpu)
 	print_cfs_stats(m, cpu);
 	print_rt_stats(m, cpu);
 
+	SEQ_printf(m, "\nss_stats[%d]:\n", cpu);
+	print_ss_stats(m, &rq->ss_stats);
+
 	rcu_read_lock();
 	print_rq(m, rq, cpu);
 	rcu_read_unlock();
@@ -404,6 +516,7 @@ __initcall(init_sched_debug_procfs);
 
 void proc_sched_show_task(struct task_struct *p, struct seq_file *m)
 {
+	struct sched_ss_server *ss;
 	unsigned long nr_switches;
 
 	SEQ_printf(m, "%s (%d, #threads: %d)\n", p->comm, p->pid,
@@ -489,6 +602,12 @@ void proc_sched_show_task(struct task_struct *p, struct seq_file *m)
 #undef P
 #undef __P
 
+	rcu_read_lock();
+	ss = ACCESS_ONCE(p->rt.ss);
+	if (ss)
+		print_task_ss_stats(m, ss);
+	rcu_read_unlock();
+
 	{
 		unsigned int this_cpu = raw_smp_processor_id();
 		u64 t0, t1;
@@ -502,7 +621,17 @@ void proc_sched_show_task(struct task_struct *p, struct seq_file *m)
 
 void proc_sched_set_task(struct task_struct *p)
 {
+	struct sched_ss_server *ss;
+
 #ifdef CONFIG_SCHEDSTATS
 	memset(&p->se.statistics, 0, sizeof(p->se.statistics));
 #endif
+
+	rcu_read_lock();
+	ss = ACCESS_ONCE(p->rt.ss);
+	if (ss) {
+		memset(&ss->stats, 0, sizeof(ss->stats));
+		ss->start = ktime_get();
+	}
+	rcu_read_unlock();
 }
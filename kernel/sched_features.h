@@ -72,3 +72,15 @@ SCHED_FEAT(NONIRQ_POWER, 1)
 SCHED_FEAT(TTWU_QUEUE, 1)
 
 SCHED_FEAT(FORCE_SD_OVERLAP, 0)
+
+/*
+ * Leave SCHED_SPORADIC budget exhaustion more than a tick away to the
+ * tick rather than arming the exhaustion timer for it.
+ */
+SCHED_FEAT(SS_TICK_ENFORCE, 1)
+
+/*
+ * Keep the budget a polling server forfeits by blocking early in a slack
+ * pool of its cpu, for other SCHED_SPORADIC servers to run on.
+ */
+SCHED_FEAT(SS_RECLAIM, 1)
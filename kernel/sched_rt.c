@@ -3,9 +3,12 @@
  * policies)
  */
 
+static struct kmem_cache *ss_server_cachep;
+
+/* servers are timed against CLOCK_MONOTONIC, as their timers */
 static inline ktime_t ss_get_now(struct task_struct *p)
 {
-	return hrtimer_cb_get_time(&p->ss_repl_timer);
+	return ktime_get();
 }
 
 static inline int ss_fg_prio(struct task_struct *p)
@@ -13,9 +16,13 @@ static inline int ss_fg_prio(struct task_struct *p)
 	return MAX_RT_PRIO-1 - p->rt_priority;
 }
 
+/* with SS_BG_FAIR, bg is the nice level and p is in the fair class */
 static inline int ss_bg_prio(struct task_struct *p)
 {
-	return p->sched_ss_low_priority;
+	if (p->rt.ss->bg_policy == SS_BG_FAIR)
+		return p->static_prio;
+
+	return p->rt.ss->low_priority;
 }
 
 static inline bool ss_curr_prio_fg(struct task_struct *p)
@@ -26,111 +33,304 @@ static inline bool ss_curr_prio_fg(struct task_struct *p)
 	return false;
 }
 
+/* also after a nice change moved the bg priority of SS_BG_FAIR */
 static inline bool ss_curr_prio_bg(struct task_struct *p)
 {
-	if (p->normal_prio == ss_bg_prio(p))
-		return true;
-
-	return false;
+	return !ss_curr_prio_fg(p);
 }
 
-/* Replenishment list functions */
-static bool ss_rl_empty(struct task_struct *p)
+/* p waits in bg for a replenishment */
+static inline bool ss_task_exhausted(struct task_struct *p)
 {
-	return (p->repl_head == -1);
+	return p->policy == SCHED_SPORADIC && ss_curr_prio_bg(p);
 }
 
-static bool ss_rl_full(struct task_struct *p)
+/*
+ * p is exhausted with SS_BG_SUSPEND: it stays off the rt_rq, though
+ * p->on_rq is set.  A boost keeps it queued, it holds a lock.
+ */
+static inline bool ss_task_suspended(struct task_struct *p)
 {
-	/* > should not be possible, means we exceeded max_repl */
-	return (p->repl_head+1 >= p->sched_ss_max_repl);
+	return ss_task_exhausted(p) && p->rt.ss->bg_policy == SS_BG_SUSPEND &&
+	       p->prio == p->normal_prio;
 }
 
 /**
- * @return: number of replenishments currently in use.
+ * @return: true for servers replenished at period boundaries (polling and
+ * deferrable), false for sporadic servers.
  */
-static int ss_rl_size(struct task_struct *p)
+static inline bool ss_periodic(struct sched_ss_server *ss)
+{
+	return ss->mode != SS_MODE_SPORADIC;
+}
+
+/* the rq the server runs on */
+static inline struct rq *ss_rq(struct sched_ss_server *ss)
+{
+#ifdef CONFIG_RT_GROUP_SCHED
+	if (!ss->task)
+		return ss->rt_rq->rq;
+#endif
+	return task_rq(ss->task);
+}
+
+/* a group server has no rq until it is installed */
+static inline bool ss_bound(struct sched_ss_server *ss)
 {
-	return (p->sched_ss_max_repl - (p->repl_head+1));
+#ifdef CONFIG_RT_GROUP_SCHED
+	if (!ss->task)
+		return ss->rt_rq != NULL;
+#endif
+	return true;
 }
 
-static struct sched_ss_repl ss_rl_pop(struct task_struct *p)
+/* account a statistic both to the server and to its cpu */
+#define ss_stat_add(ss, field, val)				\
+	do {							\
+		(ss)->stats.field += (val);			\
+		ss_rq(ss)->ss_stats.field += (val);		\
+	} while (0)
+
+#define ss_stat_max(ss, field, val)				\
+	do {							\
+		struct rq *__rq = ss_rq(ss);			\
+		(ss)->stats.field = max((ss)->stats.field, (val));	\
+		__rq->ss_stats.field = max(__rq->ss_stats.field, (val)); \
+	} while (0)
+
+/* a server waiting since a wakeup got fg priority at @now */
+static void ss_stat_latency(struct sched_ss_server *ss, ktime_t now)
 {
-	BUG_ON(ss_rl_empty(p));
+	s64 lat;
+
+	if (!ss->wakeup.tv64)
+		return;
+
+	lat = max_t(s64, ktime_to_ns(ktime_sub(now, ss->wakeup)), 0);
+	ss->wakeup.tv64 = 0;
 
-	return p->ss_repl_list[p->repl_head--];
+	ss_stat_add(ss, lat_hist[min(fls64(lat >> 10), SS_LAT_BUCKETS - 1)], 1);
 }
 
 /*
-static void ss_rl_push(struct task_struct *p, struct sched_ss_repl repl)
+ * Replenishment list functions
+ *
+ * ss->repl_list is a ring of max_repl+1 entries.  The front entry
+ * (ss->repl_list[ss->repl_head]) holds the execution capacity that has
+ * already arrived, ss->usage is charged against it.  It is followed by the
+ * nr_repl pending replenishments, ordered by time.
+ */
+static inline int ss_rl_idx(struct sched_ss_server *ss, int i)
 {
-	BUG_ON(ss_rl_full(p));
+	return (ss->repl_head + i) % (ss->max_repl + 1);
+}
 
-	p->ss_repl_list[++p->repl_head] = repl;
+static bool ss_rl_empty(struct sched_ss_server *ss)
+{
+	/* no pending replenishments */
+	return (ss->nr_repl == 0);
 }
 
-static void ss_rl_replace_front(struct task_struct *p, struct sched_ss_repl repl)
+static bool ss_rl_full(struct sched_ss_server *ss)
 {
-	p->ss_repl_list[p->repl_head] = repl;
+	/* > should not be possible, means we exceeded max_repl */
+	return (ss->nr_repl >= ss->max_repl);
 }
-*/
 
 /**
- * Assumes there is one space/slot available in the replenishment list.
+ * @return: number of replenishments currently pending.
  */
-static void ss_rl_add(struct task_struct *p, struct sched_ss_repl repl)
+static int ss_rl_size(struct sched_ss_server *ss)
 {
-	int i;
+	return ss->nr_repl;
+}
 
-	for (i=p->repl_head; i>=0; --i) {
-		p->ss_repl_list[i+1] = p->ss_repl_list[i];
-	}
+static inline struct sched_ss_repl *ss_rl_front(struct sched_ss_server *ss)
+{
+	return &ss->repl_list[ss->repl_head];
+}
+
+/**
+ * @return: the earliest pending replenishment.
+ */
+static inline struct sched_ss_repl *ss_rl_next(struct sched_ss_server *ss)
+{
+	BUG_ON(ss_rl_empty(ss));
+
+	return &ss->repl_list[ss_rl_idx(ss, 1)];
+}
+
+/**
+ * @return: the latest pending replenishment.
+ */
+static inline struct sched_ss_repl *ss_rl_last(struct sched_ss_server *ss)
+{
+	BUG_ON(ss_rl_empty(ss));
+
+	return &ss->repl_list[ss_rl_idx(ss, ss->nr_repl)];
+}
 
-	p->ss_repl_list[0] = repl;
+static struct sched_ss_repl ss_rl_pop(struct sched_ss_server *ss)
+{
+	struct sched_ss_repl front = *ss_rl_front(ss);
+
+	BUG_ON(ss_rl_empty(ss));
+
+	ss->repl_head = ss_rl_idx(ss, 1);
+	ss->nr_repl--;
+
+	return front;
+}
+
+static void ss_rl_replace_front(struct sched_ss_server *ss, struct sched_ss_repl repl)
+{
+	ss->repl_list[ss->repl_head] = repl;
+}
 
-	p->repl_head++;
+/**
+ * Assumes there is one space/slot available in the replenishment list.
+ */
+static void ss_rl_add(struct sched_ss_server *ss, struct sched_ss_repl repl)
+{
+	ss->repl_list[ss_rl_idx(ss, ss->nr_repl + 1)] = repl;
+	ss->nr_repl++;
 }
 
-static bool ss_valid_rl(struct task_struct *p)
+static bool ss_valid_rl(struct sched_ss_server *ss)
 {
 	/*
-	 * -1 (empty), but cannot ever be empty
-	 * >= p->sched_ss_max_repl-1 (full)
+	 * 0 (no pending replenishments)
+	 * ss->max_repl (full)
 	 */
-	if (p->repl_head < 0 || p->repl_head >= p->sched_ss_max_repl) {
+	if (ss->repl_head < 0 || ss->repl_head > ss->max_repl ||
+	    ss_rl_size(ss) > ss->max_repl) {
 		return false;
 	}
 
-	/* TODO: validate capacity is not > sched_ss_init_budget
-	 * iterate through all replenishments
-	 * BUG_ON();
+#ifdef CONFIG_SCHED_DEBUG
+	/*
+	 * Capacity is only moved between the front and the pending
+	 * replenishments, so together they never exceed the budget.
 	 */
-/*
-	int i;
-	for (i=p->repl_head; i>=0; --i) {
-		if (ktime_cmp(now, p->ss_repl_list[i].time) < 0) {
-			break;
-		}
-		capacity = ktime_add(capacity, p->ss_repl_list[i].amt);
+	{
+		ktime_t total = ns_to_ktime(0);
+		int i;
+
+		for (i=0; i<=ss->nr_repl; ++i)
+			total = ktime_add(total, ss->repl_list[ss_rl_idx(ss, i)].amt);
+
+		if (ktime_cmp(total, ss->init_budget) > 0)
+			return false;
 	}
-*/
+#endif
 
 	return true;
 }
 
-/**
- * Assumes p is scheduled using SCHED_SPORADIC policy.
+static inline ktime_t ss_capacity(struct sched_ss_server *ss, ktime_t now)
+{
+    BUG_ON(!ss_valid_rl(ss));
+
+    return ktime_add(ktime_sub(ss_rl_front(ss)->amt, ss->usage), ss->slack);
+}
+
+/* @delta ns of fg runtime are charged to ss, to the slack it drew first */
+static inline void ss_charge(struct sched_ss_server *ss, u64 delta)
+{
+	u64 slack = min_t(u64, ktime_to_ns(ss->slack), delta);
+
+	ss->slack = ktime_sub_ns(ss->slack, slack);
+	ss->usage = ktime_add_ns(ss->usage, delta - slack);
+}
+
+static inline bool ss_out_of_budget(struct sched_ss_server *ss, ktime_t now)
+{
+	return ktime_cmp(ss_capacity(ss, now), ns_to_ktime(0)) <= 0;
+}
+
+/*
+ * The exhaustion timer is armed early by its average latency, up to
+ * SS_EXH_LAT_MAX_NS.  A remainder below SS_EXH_MIN_NS is not worth
+ * another timer.
+ */
+#define SS_EXH_LAT_MAX_NS	50000
+#define SS_EXH_MIN_NS		1000
+
+/* what is left of a budget at exhaustion may be expired with it */
+static inline s64 ss_exh_margin(struct rq *rq)
+{
+	return max_t(s64, rq->ss_exh_lat, SS_EXH_MIN_NS);
+}
+
+/*
+ * Is ss out of capacity as far as enforcement goes?  A remainder of up to
+ * @margin ns is expired along with the budget: a sporadic server gets it
+ * back with the rest of the usage, a periodic one loses it until its next
+ * boundary.  It is not carried over, the front never holds more than
+ * init_budget.
  */
-static inline ktime_t ss_capacity(struct task_struct *p, ktime_t now)
+static bool ss_exh_expire(struct sched_ss_server *ss, ktime_t now, s64 margin)
 {
-    BUG_ON(!ss_valid_rl(p));
+	ktime_t left = ss_capacity(ss, now);
+
+	if (left.tv64 > margin)
+		return false;
+
+	if (left.tv64 > 0) {
+		ss->usage = ss_rl_front(ss)->amt;
+		ss->slack = ns_to_ktime(0);
+	}
+
+	return true;
+}
+
+/*
+ * Status page
+ *
+ * A task that mapped /proc/<pid>/ss_status gets its sched_ss_status
+ * refreshed whenever its server changes: usage is charged, capacity is
+ * added, or it switches between fg and bg.  The writers are serialized by
+ * task_rq(p)->lock, or by p->pi_lock while p is blocked.
+ */
+static void __ss_status_update(struct task_struct *p)
+{
+	struct sched_ss_status *st = p->rt.ss_status;
+	struct sched_ss_server *ss = p->rt.ss;
+	ktime_t now = ktime_get();
+
+	st->seq++;
+	smp_wmb();
+
+	st->stamp = ktime_to_ns(now);
+	if (ss) {
+		st->flags = SS_STATUS_ACTIVE;
+		if (ss_curr_prio_fg(p))
+			st->flags |= SS_STATUS_FG;
+		st->capacity = max_t(s64, ktime_to_ns(ss_capacity(ss, now)), 0);
+		if (ss_periodic(ss)) {
+			st->next_repl = ktime_to_ns(ss->repl_expires);
+			st->next_amt = ktime_to_ns(ss->init_budget);
+		} else if (!ss_rl_empty(ss)) {
+			st->next_repl = ktime_to_ns(ss_rl_next(ss)->time);
+			st->next_amt = ktime_to_ns(ss_rl_next(ss)->amt);
+		} else {
+			st->next_repl = 0;
+			st->next_amt = 0;
+		}
+		st->budget = ktime_to_ns(ss->init_budget);
+		st->period = ktime_to_ns(ss->repl_period);
+	} else {
+		st->flags = 0;
+	}
 
-    return ktime_sub(p->ss_repl_list[p->repl_head].amt, p->ss_usage);
+	smp_wmb();
+	st->seq++;
 }
 
-static inline bool ss_out_of_budget(struct task_struct *p, ktime_t now)
+static inline void ss_status_update(struct task_struct *p)
 {
-	return ktime_cmp(ss_capacity(p, now), ns_to_ktime(0)) <= 0;
+	if (unlikely(p->rt.ss_status))
+		__ss_status_update(p);
 }
 
 static void
@@ -139,59 +339,1511 @@ prio_changed_rt(struct rq *rq, struct task_struct *p, int oldprio);
 static void ss_change_prio(struct rq *rq, struct task_struct *p,
 	int new_prio);
 
-static void ss_split_check(struct task_struct *p, ktime_t now)
+/*
+ * Arm a per-rq SCHED_SPORADIC timer.  As for the rt bandwidth and hrtick
+ * timers, the softirq must not be woken from here since that could take
+ * rq->lock again.
+ *
+ * The timers are pinned so that their callbacks run on the cpu of the rq
+ * and take a local rq->lock: a timer of a remote rq is armed by sending
+ * the csd to its cpu, whose handler arms it again from there.  The only
+ * exception is an offline cpu, whose timers are armed from here and are
+ * anyway migrated by the hrtimer code when it goes down; the callbacks
+ * then take a remote rq->lock, which is harmless since nothing runs on it.
+ */
+static void ss_start_timer(struct rq *rq, struct hrtimer *timer,
+	ktime_t time, unsigned long slack)
+{
+#ifdef CONFIG_SMP
+	if (rq != this_rq() && cpu_online(cpu_of(rq))) {
+		/* under rq->ss_tq_lock and rq->lock respectively */
+		struct call_single_data *csd = &rq->ss_tq_csd;
+		int *pending = &rq->ss_tq_csd_pending;
+
+		if (timer == &rq->ss_exh_timer) {
+			csd = &rq->ss_exh_csd;
+			pending = &rq->ss_exh_csd_pending;
+		}
+
+		if (!*pending) {
+			__smp_call_function_single(cpu_of(rq), csd, 0);
+			*pending = 1;
+		}
+		return;
+	}
+#endif
+	__hrtimer_start_range_ns(timer, time, slack,
+				 HRTIMER_MODE_ABS_PINNED, 0);
+}
+
+/*
+ * Replenishment timer queue
+ *
+ * The servers waiting for a replenishment, or polling and deferrable
+ * servers waiting for their next period boundary, are kept in rq->ss_tq
+ * in time order.  One hrtimer per rq is programmed for the earliest of
+ * them, and its callback handles every server that is due under a single
+ * acquisition of rq->lock.  sysctl_sched_ss_timer_slack lets the timer be
+ * delayed so that replenishments close together share one expiry.
+ *
+ * A server is queued on the rq of its task (ss->repl_rq) and moves along
+ * with the task in set_task_cpu().  A callback that races with a
+ * migration passes the server on to the queue of the new rq.
+ * rq->ss_tq_lock protects the queue and nests inside rq->lock of any cpu.
+ * ss->repl_rq only goes from an rq to NULL under the ss_tq_lock of that
+ * rq and from NULL to an rq by cmpxchg, so a server is never on two
+ * queues.
+ */
+
+/* a server whose task is being woken up is looked at again after this */
+#define SS_TQ_RETRY_NS	10000
+
+static inline bool ss_repl_queued(struct sched_ss_server *ss)
+{
+	return ACCESS_ONCE(ss->repl_rq) != NULL;
+}
+
+/* program the timer of rq for the earliest server, rq->ss_tq_lock is held */
+static void ss_tq_program(struct rq *rq)
+{
+	struct timerqueue_node *next = timerqueue_getnext(&rq->ss_tq);
+	struct hrtimer *timer = &rq->ss_timer;
+
+	if (!next)
+		return;
+
+	/* an earlier expiry left behind by a removed server is harmless */
+	if (hrtimer_is_queued(timer) &&
+	    ktime_cmp(hrtimer_get_softexpires(timer), next->expires) <= 0)
+		return;
+
+	ss_start_timer(rq, timer, next->expires, sysctl_sched_ss_timer_slack);
+}
+
+#ifdef CONFIG_SMP
+/* called from hardirq (IPI) context, see ss_start_timer() */
+static void __ss_tq_program(void *arg)
+{
+	struct rq *rq = arg;
+
+	raw_spin_lock(&rq->ss_tq_lock);
+	rq->ss_tq_csd_pending = 0;
+	ss_tq_program(rq);
+	raw_spin_unlock(&rq->ss_tq_lock);
+}
+#endif
+
+/* take ss off the queue it is on, if any */
+static void ss_tq_del(struct sched_ss_server *ss)
+{
+	struct rq *rq;
+
+	while ((rq = ACCESS_ONCE(ss->repl_rq))) {
+		raw_spin_lock(&rq->ss_tq_lock);
+		if (likely(ss->repl_rq == rq)) {
+			timerqueue_del(&rq->ss_tq, &ss->repl_node);
+			ss->repl_rq = NULL;
+		}
+		raw_spin_unlock(&rq->ss_tq_lock);
+	}
+}
+
+/* (re)queue ss on the queue of rq, to expire at @expires */
+static void ss_tq_add(struct sched_ss_server *ss, struct rq *rq,
+	ktime_t expires)
+{
+	struct rq *old;
+
+	for (;;) {
+		raw_spin_lock(&rq->ss_tq_lock);
+		old = cmpxchg(&ss->repl_rq, NULL, rq);
+		if (old == rq)
+			timerqueue_del(&rq->ss_tq, &ss->repl_node);
+		if (!old || old == rq)
+			break;
+		raw_spin_unlock(&rq->ss_tq_lock);
+		ss_tq_del(ss);
+	}
+
+	/* pairs with the barrier in ss_repl_stop() */
+	if (unlikely(ss->stopped)) {
+		ss->repl_rq = NULL;
+		raw_spin_unlock(&rq->ss_tq_lock);
+		return;
+	}
+
+	ss->repl_node.expires = expires;
+	timerqueue_add(&rq->ss_tq, &ss->repl_node);
+	if (timerqueue_getnext(&rq->ss_tq) == &ss->repl_node)
+		ss_tq_program(rq);
+	raw_spin_unlock(&rq->ss_tq_lock);
+}
+
+/*
+ * ss is never queued again.  Either ss_tq_add() sees the stopped flag
+ * after its cmpxchg, or the server is seen queued and taken off here.
+ */
+static void ss_repl_stop(struct sched_ss_server *ss)
+{
+	unsigned long flags;
+
+	ss->stopped = 1;
+	smp_mb();
+
+	local_irq_save(flags);
+	ss_tq_del(ss);
+	local_irq_restore(flags);
+}
+
+/* keep the server queued for its earliest pending replenishment */
+static void ss_arm_repl_timer(struct sched_ss_server *ss)
+{
+	if (ss_rl_empty(ss))
+		return;
+
+	if (ss_repl_queued(ss) &&
+	    ktime_equal(ss->repl_expires, ss_rl_next(ss)->time))
+		return;
+
+	ss->repl_expires = ss_rl_next(ss)->time;
+	ss_tq_add(ss, ss_rq(ss), ss->repl_expires);
+}
+
+/**
+ * The current fg activation ends.  Charge the capacity consumed since
+ * ss->act_time and queue a replenishment of the same amount one period
+ * after the activation started.
+ *
+ * Assumes rq->lock is held.
+ */
+static void ss_split_check(struct sched_ss_server *ss)
+{
+	struct sched_ss_repl front = *ss_rl_front(ss);
+	struct sched_ss_repl repl;
+	ktime_t overrun = ns_to_ktime(0);
+
+	/* slack drawn but left unused is not carried over */
+	ss->slack = ns_to_ktime(0);
+
+	if (ktime_to_ns(ss->usage) <= 0) {
+		ss->usage = ns_to_ktime(0);
+		return;
+	}
+
+	repl.amt = ss->usage;
+	repl.time = ktime_add(ss->act_time, ss->repl_period);
+
+	/* an overrun is not replenished beyond the capacity we had */
+	if (ktime_cmp(repl.amt, front.amt) > 0) {
+		u64 ns;
+
+		overrun = ktime_sub(repl.amt, front.amt);
+		ns = ktime_to_ns(overrun);
+
+		ss_stat_add(ss, nr_overrun, 1);
+		ss_stat_add(ss, overrun_sum, ns);
+		ss_stat_max(ss, overrun_max, ns);
+		trace_sched_ss_overrun(ss, ns);
+
+		repl.amt = front.amt;
+	}
+
+	front.amt = ktime_sub(front.amt, repl.amt);
+	ss_rl_replace_front(ss, front);
+
+	/*
+	 * What went beyond the capacity is paid back from the capacity added
+	 * next.  A polling or deferrable server is refilled to its budget, so
+	 * the overrun is taken off as debt.  A sporadic server is replenished
+	 * with what it consumed: the overrun stays charged to it as usage of
+	 * its next activation, and comes back one period after that.
+	 */
+	if (ss_periodic(ss)) {
+		ss->debt = ktime_add(ss->debt, overrun);
+		ss->usage = ns_to_ktime(0);
+		/* they get the rest back at the period boundary */
+		return;
+	}
+	ss->usage = overrun;
+
+	if (ss_rl_full(ss)) {
+		/*
+		 * No slot left: fold the chunk into the latest pending
+		 * replenishment and delay that one to our time instead.
+		 */
+		struct sched_ss_repl *last = ss_rl_last(ss);
+
+		last->amt = ktime_add(last->amt, repl.amt);
+		last->time = repl.time;
+	} else {
+		ss_rl_add(ss, repl);
+	}
+
+	ss_arm_repl_timer(ss);
+}
+
+/*
+ * Capacity @amt is added to ss: pay back the debt from it first.
+ *
+ * @return: the capacity left to add.
+ */
+static ktime_t ss_debit(struct sched_ss_server *ss, ktime_t amt)
+{
+	s64 debt = ktime_to_ns(ss->debt);
+	s64 ns = ktime_to_ns(amt);
+
+	if (debt > ns) {
+		ss->debt = ns_to_ktime(debt - ns);
+		return ns_to_ktime(0);
+	}
+
+	ss->debt = ns_to_ktime(0);
+	return ns_to_ktime(ns - debt);
+}
+
+static bool ss_retune_apply(struct sched_ss_server *ss);
+
+/**
+ * Move the replenishments that are due at @now into the front entry.
+ *
+ * @return: true if any replenishment arrived.
+ */
+static bool ss_rl_merge(struct sched_ss_server *ss, ktime_t now)
+{
+	bool merged = false;
+
+	while (!ss_rl_empty(ss) && ktime_cmp(ss_rl_next(ss)->time, now) <= 0) {
+		struct sched_ss_repl front = ss_rl_pop(ss);
+		struct sched_ss_repl repl = *ss_rl_front(ss);
+
+		repl.amt = ktime_add(repl.amt, ss_debit(ss, front.amt));
+		ss_rl_replace_front(ss, repl);
+		merged = true;
+	}
+
+	if (merged)
+		ss_retune_apply(ss);
+
+	return merged;
+}
+
+/**
+ * Polling and deferrable servers: the full budget is available again from
+ * the period start @start.
+ */
+static void ss_refill(struct sched_ss_server *ss, ktime_t start)
+{
+	struct sched_ss_repl front;
+
+	/* a new period is timed from this one's start */
+	if (ss_retune_apply(ss))
+		ss->repl_expires = ktime_add(start, ss->repl_period);
+
+	front.amt = ss_debit(ss, ss->init_budget);
+	front.time = start;
+	ss_rl_replace_front(ss, front);
+
+	ss->usage = ns_to_ktime(0);
+	ss->slack = ns_to_ktime(0);
+	ss->act_time = start;
+}
+
+/* forward the replenishment time in interval(polling) increments */
+static int ss_fwd_repl_timer(struct sched_ss_server *ss, ktime_t now)
+{
+	int periods = 0;
+	ktime_t interval = ss->repl_period;
+
+	if (ktime_cmp(ss->repl_expires, now) > 0) {
+		/* timer already set to beginning of next period */
+		return 0;
+	}
+
+	do {
+		periods++;
+		ss->repl_expires = ktime_add(ss->repl_expires, interval);
+	} while(ktime_cmp(ss->repl_expires, now) <= 0);
+
+	return periods;
+}
+
+static void ss_ctl_period(struct sched_ss_server *ss);
+
+/**
+ * Polling and deferrable servers: a period boundary was reached.  Refill the
+ * budget, adapted to the period that ended if ss has a controller, and keep
+ * the timer going while the server is @ready.
+ *
+ * @return: number of periods passed since the timer was set.
+ */
+static int ss_period_boundary(struct sched_ss_server *ss, ktime_t now,
+	bool ready)
+{
+	int periods_passed = ss_fwd_repl_timer(ss, now);
+
+	ss_ctl_period(ss);
+
+	/* the period started at the boundary, not at now, prevents drift */
+	ss_refill(ss, ktime_sub(ss->repl_expires, ss->repl_period));
+
+	if (ready)
+		ss_tq_add(ss, ss_rq(ss), ss->repl_expires);
+
+	return periods_passed;
+}
+
+/* the timer is expected to fire once per period */
+static inline void ss_period_skip_check(struct sched_ss_server *ss, int periods)
+{
+	if (periods == 1)
+		return;
+
+	if (periods > 1)
+		ss_stat_add(ss, nr_period_skip, periods - 1);
+	trace_sched_ss_period_skip(ss, periods);
+}
+
+/**
+ * Polling and deferrable servers: the replenishment timer only runs while
+ * the server is ready.  Catch up on the period boundaries passed while it
+ * was blocked.
+ */
+static void ss_unblock_periodic(struct sched_ss_server *ss, ktime_t now)
+{
+	if (ss_repl_queued(ss))
+		return;
+
+	/*
+	 * A deferrable server got a new budget at each boundary.  A polling
+	 * server had no work pending when it polled, so its budget is gone
+	 * until the next boundary.
+	 */
+	if (ss_fwd_repl_timer(ss, now) && ss->mode == SS_MODE_DEFERRABLE)
+		ss_refill(ss, ktime_sub(ss->repl_expires, ss->repl_period));
+
+	ss_tq_add(ss, ss_rq(ss), ss->repl_expires);
+}
+
+/*
+ * Slack reclaiming
+ *
+ * A polling server that blocks early forfeits the rest of its budget, but
+ * that bandwidth stays reserved for it until its next period boundary.
+ * Until then it is kept in a slack pool of the rq, as in CASH, and a
+ * server about to run out draws from the pool before it is demoted.  What
+ * is drawn is kept in ss->slack and used before the server's own budget,
+ * so that only the budget used is replenished, and what is left of it
+ * when the activation ends is dropped.
+ *
+ * Only servers with an fg priority at or below that of every donor draw,
+ * so that no task sees more interference than admission assumed.  The
+ * donations are merged into a single pool which expires at the earliest
+ * of their deadlines.
+ *
+ * All of these assume rq->lock is held.
+ */
+static void ss_slack_give(struct rq *rq, struct sched_ss_server *ss,
+	ktime_t now)
+{
+	/* slack ss drew itself is not passed on, its deadline may be earlier */
+	s64 amt = ktime_to_ns(ktime_sub(ss_capacity(ss, now), ss->slack));
+
+	if (!sched_feat(SS_RECLAIM) || amt <= 0 ||
+	    ktime_cmp(ss->repl_expires, now) <= 0)
+		return;
+
+	if (ktime_cmp(rq->ss_slack_expires, now) <= 0)
+		rq->ss_slack = 0;
+
+	if (!rq->ss_slack) {
+		rq->ss_slack_expires = ss->repl_expires;
+		rq->ss_slack_prio = ss->prio;
+	} else {
+		if (ktime_cmp(ss->repl_expires, rq->ss_slack_expires) < 0)
+			rq->ss_slack_expires = ss->repl_expires;
+		rq->ss_slack_prio = max(rq->ss_slack_prio, ss->prio);
+	}
+	rq->ss_slack += amt;
+	ss_stat_add(ss, slack_given, amt);
+}
+
+/*
+ * Extend the capacity of ss from the pool, by no more than it can use
+ * before the pool expires.
+ *
+ * @return: true if ss got capacity.
+ */
+static bool ss_slack_take(struct rq *rq, struct sched_ss_server *ss,
+	ktime_t now)
+{
+	s64 left;
+	u64 amt;
+
+	if (!sched_feat(SS_RECLAIM) || !rq->ss_slack ||
+	    ss->prio < rq->ss_slack_prio)
+		return false;
+
+	left = ktime_to_ns(ktime_sub(rq->ss_slack_expires, now));
+	if (left <= 0) {
+		rq->ss_slack = 0;
+		return false;
+	}
+
+	amt = min_t(u64, rq->ss_slack, left);
+	rq->ss_slack -= amt;
+	ss->slack = ktime_add_ns(ss->slack, amt);
+	ss_stat_add(ss, slack_drawn, amt);
+
+	return true;
+}
+
+/**
+ * Ends the fg activation of p if it has run out of capacity.
+ *
+ * Assumes rq->lock is held.
+ */
+static void ss_budget_check(struct rq *rq, struct task_struct *p, ktime_t now)
+{
+	assert_raw_spin_locked(&task_rq(p)->lock);
+
+	if (ss_curr_prio_fg(p) && ss_out_of_budget(p->rt.ss, now) &&
+	    !ss_slack_take(rq, p->rt.ss, now)) {
+		ss_stat_add(p->rt.ss, nr_exhaust, 1);
+		trace_sched_ss_exhaust(p->rt.ss);
+		ss_split_check(p->rt.ss);
+		ss_change_prio(rq, p, ss_bg_prio(p));
+	}
+}
+
+/**
+ * Assumes p is ready to run when called.  Starts a fg activation if p
+ * has capacity left.
+ *
+ * @return:
+ * 	- p has capacity to run now.
+ */
+static bool ss_unblock_check(struct task_struct *p, ktime_t now)
+{
+	if (ss_out_of_budget(p->rt.ss, now))
+		return false;
+
+	p->rt.ss->act_time = now;
+
+	return true;
+}
+
+/**
+ * Set the priority of p while it is not queued on an rt_rq.  Unlike
+ * ss_change_prio() the rt_rq is not touched and p->pi_lock is not taken;
+ * a concurrent boost is serialized by rq->lock in rt_mutex_setprio().
+ */
+static void __ss_set_prio(struct task_struct *p, int new_prio)
+{
+	trace_sched_ss_prio_change(p->rt.ss, p->normal_prio, new_prio);
+	p->normal_prio = new_prio;
+	p->prio = rt_mutex_getprio(p);
+	ss_status_update(p);
+}
+
+/**
+ * Allocate a server for p, or for a task group when p is NULL, with the
+ * parameters in @param, in user representation.  The ring is sized to exactly the front entry plus
+ * sched_ss_max_repl pending replenishments.
+ *
+ * May sleep, so it is called before rq->lock is taken.
+ */
+static struct sched_ss_server *ss_alloc_server(struct task_struct *p,
+	const struct sched_param *param)
+{
+	struct sched_ss_server *ss;
+
+	ss = kmem_cache_zalloc(ss_server_cachep, GFP_KERNEL);
+	if (!ss)
+		return NULL;
+
+	ss->repl_list = kcalloc(param->sched_ss_max_repl + 1,
+				sizeof(struct sched_ss_repl), GFP_KERNEL);
+	if (!ss->repl_list) {
+		kmem_cache_free(ss_server_cachep, ss);
+		return NULL;
+	}
+
+	ss->task = p;
+
+	/* put priority into kernel's representation */
+	ss->low_priority = MAX_RT_PRIO-1 - param->sched_ss_low_priority;
+	ss->repl_period = timespec_to_ktime(param->sched_ss_repl_period);
+	ss->init_budget = timespec_to_ktime(param->sched_ss_init_budget);
+	ss->max_repl = param->sched_ss_max_repl;
+	ss->mode = param->sched_ss_mode;
+	ss->bg_policy = param->sched_ss_bg_policy;
+	ss->prio = MAX_RT_PRIO-1 - param->sched_priority;
+	ss->ctl.min_budget = timespec_to_ktime(param->sched_ss_min_budget);
+	ss->ctl.max_budget = timespec_to_ktime(param->sched_ss_max_budget);
+
+	ss->bw = to_ratio(ktime_to_ns(ss->repl_period),
+			  ktime_to_ns(ss->init_budget));
+	INIT_LIST_HEAD(&ss->bw_node);
+
+	timerqueue_init(&ss->repl_node);
+
+	return ss;
+}
+
+static void ss_free_server_rcu(struct rcu_head *head)
+{
+	struct sched_ss_server *ss = container_of(head, struct sched_ss_server, rcu);
+
+	kfree(ss->repl_list);
+	kmem_cache_free(ss_server_cachep, ss);
+}
+
+static void ss_bw_release(struct sched_ss_server *ss);
+
+/**
+ * Readers of another task's server (sched_getparam(), fork, the timer
+ * queue callback) only hold rcu_read_lock(), so the memory goes away
+ * after a grace period.
+ *
+ * Must not be called with rq->lock held, the timer callbacks take it.
+ */
+static void ss_free_server(struct sched_ss_server *ss)
+{
+	if (!ss)
+		return;
+
+	ss_bw_release(ss);
+
+	/* a timer queue callback handling ss holds the lock of its rq */
+	ss_repl_stop(ss);
+	if (ss_bound(ss))
+		raw_spin_unlock_wait(&ss_rq(ss)->lock);
+
+	call_rcu(&ss->rcu, ss_free_server_rcu);
+}
+
+/**
+ * Fill the SCHED_SPORADIC members of @param, in user representation.
+ */
+static void ss_get_param(struct sched_ss_server *ss, struct sched_param *param)
+{
+	param->sched_priority = MAX_RT_PRIO-1 - ss->prio;
+	param->sched_ss_low_priority = MAX_RT_PRIO-1 - ss->low_priority;
+	param->sched_ss_repl_period = ktime_to_timespec(ss->repl_period);
+	param->sched_ss_init_budget = ktime_to_timespec(ss->init_budget);
+	param->sched_ss_max_repl = ss->max_repl;
+	param->sched_ss_mode = ss->mode;
+	param->sched_ss_bg_policy = ss->bg_policy;
+	param->sched_ss_min_budget = ktime_to_timespec(ss->ctl.min_budget);
+	param->sched_ss_max_budget = ktime_to_timespec(ss->ctl.max_budget);
+}
+
+/* full budget and no pending replenishments */
+static void ss_reset_server(struct sched_ss_server *ss, ktime_t now)
+{
+	ss->repl_head = 0;
+	ss->nr_repl = 0;
+	ss->repl_list[0].amt = ss->init_budget;
+	ss->repl_list[0].time = now;
+
+	ss->usage = ns_to_ktime(0);
+	ss->slack = ns_to_ktime(0);
+	ss->debt = ns_to_ktime(0);
+	ss->act_time = now;
+	ss->start = now;
+
+	/* first period boundary, the timer is started when the server is ready */
+	if (ss_periodic(ss))
+		ss->repl_expires = ktime_add(now, ss->repl_period);
+}
+
+/**
+ * (Re)starts the server of p.  p starts in bg and is promoted to fg when
+ * it is enqueued.  Only sets normal_prio, the caller updates p->prio.
+ */
+static void ss_init_server(struct task_struct *p, ktime_t now)
+{
+	p->normal_prio = ss_bg_prio(p);
+	ss_reset_server(p->rt.ss, now);
+	p->rt.ss->job_start = p->se.sum_exec_runtime;
+}
+
+/**
+ * p leaves SCHED_SPORADIC or gets a new server.
+ *
+ * rq->lock is held.  A callback that is already running notices p->rt.ss
+ * changed once it gets rq->lock.
+ */
+static void ss_stop_server(struct task_struct *p)
+{
+	ss_repl_stop(p->rt.ss);
+}
+
+/**
+ * p is dead.  Replenishments stay queued while a server is blocked, so
+ * stop the timers now and give back the reserved utilization; the server
+ * itself is freed with the task_struct.
+ */
+static void ss_task_dead(struct task_struct *p)
+{
+	if (!p->rt.ss)
+		return;
+
+	ss_bw_release(p->rt.ss);
+	ss_repl_stop(p->rt.ss);
+}
+
+#ifdef CONFIG_SMP
+/**
+ * p moves to @cpu.  Its pending replenishment moves along, so the timer
+ * queue callback of the old cpu does not have to pass it on and take the
+ * lock of the new rq.  Called from set_task_cpu() with p->pi_lock or the
+ * locks of both rqs held; the exhaustion timer is per rq already.
+ */
+static void ss_migrate_task(struct task_struct *p, int cpu)
+{
+	struct sched_ss_server *ss = p->rt.ss;
+	struct rq *rq = cpu_rq(cpu);
+	struct rq *old;
+
+	if (!ss)
+		return;
+
+	old = ACCESS_ONCE(ss->repl_rq);
+	if (old && old != rq)
+		ss_tq_add(ss, rq, ss->repl_expires);
+}
+#endif
+
+/*
+ * Admission control
+ *
+ * Each server reserves bw = budget/period of a cpu, in to_ratio() units.
+ * A server pinned to one cpu is charged to that cpu, others are charged
+ * to ss_unpinned_bw, which counts against every root_domain.  The totals
+ * on a cpu, or on a set of cpus, may not exceed the rt bandwidth limit of
+ * sched_rt_runtime_us/sched_rt_period_us per cpu.
+ *
+ * Servers pinned to one cpu must in addition pass a response time test:
+ * treating each server as a periodic task of its budget and period at
+ * its fg priority, all servers on the cpu must complete their budget
+ * within their period.  The recent FIFO/RR load of the cpu, as tracked in
+ * rq->rt_avg less the time consumed under servers, is taken as a fluid
+ * share of the cpu running at higher priority.
+ *
+ * ss_bw_lock nests inside rq->lock.
+ */
+static DEFINE_RAW_SPINLOCK(ss_bw_lock);
+static LIST_HEAD(ss_unpinned_list);
+static u64 ss_unpinned_bw;
+
+static inline u64 ss_bw_limit(void)
+{
+	return to_ratio(global_rt_period(), global_rt_runtime());
+}
+
+#ifdef CONFIG_SMP
+/* recent FIFO/RR utilization of rq, time consumed under servers excluded */
+static u64 ss_fifo_bw(struct rq *rq)
+{
+	u64 total = sched_avg_period() + (rq->clock - rq->age_stamp);
+	s64 used = ACCESS_ONCE(rq->rt_avg) - ACCESS_ONCE(rq->ss_avg);
+
+	if (used <= 0)
+		return 0;
+
+	return min_t(u64, to_ratio(total, used), (1ULL << 20) - 1);
+}
+#else
+static inline u64 ss_fifo_bw(struct rq *rq)
+{
+	return 0;
+}
+#endif
+
+static void __ss_bw_charge(struct sched_ss_server *ss, int cpu)
+{
+	ss->bw_cpu = cpu;
+
+	if (cpu < 0) {
+		list_add(&ss->bw_node, &ss_unpinned_list);
+		ss_unpinned_bw += ss->bw;
+	} else {
+		list_add(&ss->bw_node, &cpu_rq(cpu)->ss_list);
+		cpu_rq(cpu)->ss_bw += ss->bw;
+	}
+}
+
+/* @return: true if ss was charged */
+static bool __ss_bw_release(struct sched_ss_server *ss)
+{
+	if (list_empty(&ss->bw_node))
+		return false;
+
+	list_del_init(&ss->bw_node);
+	if (ss->bw_cpu < 0)
+		ss_unpinned_bw -= ss->bw;
+	else
+		cpu_rq(ss->bw_cpu)->ss_bw -= ss->bw;
+
+	return true;
+}
+
+/* interference of server s at higher priority over an interval of r ns */
+static inline u64 ss_rta_interference(struct sched_ss_server *s, u64 r)
+{
+	u64 period = ktime_to_ns(s->repl_period);
+
+	return div64_u64(r + period - 1, period) * ktime_to_ns(s->init_budget);
+}
+
+/*
+ * Response time test for ss among the servers on rq plus the candidate
+ * @new, which is not on rq->ss_list yet.  Servers of equal priority are
+ * FIFO among each other and interfere as if of higher priority.
+ */
+static bool ss_rta_ok(struct rq *rq, struct sched_ss_server *ss,
+	struct sched_ss_server *new, u64 fifo_bw)
+{
+	u64 budget = ktime_to_ns(ss->init_budget);
+	u64 period = ktime_to_ns(ss->repl_period);
+	u64 r = budget, next;
+	struct sched_ss_server *s;
+
+	for (;;) {
+		next = budget;
+		list_for_each_entry(s, &rq->ss_list, bw_node) {
+			if (s != ss && s->prio <= ss->prio)
+				next += ss_rta_interference(s, r);
+		}
+		if (new != ss && new->prio <= ss->prio)
+			next += ss_rta_interference(new, r);
+
+		next = div64_u64(next << 20, (1ULL << 20) - fifo_bw);
+
+		if (next > period)
+			return false;
+		if (next <= r)
+			return true;
+		r = next;
+	}
+}
+
+static bool ss_bw_fits_cpu(struct sched_ss_server *ss, int cpu)
+{
+	struct rq *rq = cpu_rq(cpu);
+	u64 fifo_bw = ss_fifo_bw(rq);
+	struct sched_ss_server *s;
+
+	if (rq->ss_bw + ss->bw > ss_bw_limit())
+		return false;
+
+	if (!ss_rta_ok(rq, ss, ss, fifo_bw))
+		return false;
+
+	/* the servers below ss now see its interference as well */
+	list_for_each_entry(s, &rq->ss_list, bw_node) {
+		if (s->prio >= ss->prio && !ss_rta_ok(rq, s, ss, fifo_bw))
+			return false;
+	}
+
+	return true;
+}
+
+static bool ss_bw_fits_span(struct sched_ss_server *ss,
+	const struct cpumask *span)
+{
+	u64 total = ss_unpinned_bw + ss->bw;
+	int i, nr = 0;
+
+	for_each_cpu_and(i, span, cpu_active_mask) {
+		total += cpu_rq(i)->ss_bw;
+		nr++;
+	}
+
+	return ss->bw <= ss_bw_limit() && total <= nr * ss_bw_limit();
+}
+
+/*
+ * Placement
+ *
+ * With sysctl_sched_ss_placement set, a new server whose task may run on
+ * every cpu of its root_domain is pinned to one of them instead of being
+ * charged as unpinned: the cpu with the least utilization reserved that
+ * it fits on (worst fit), or the first one (first fit).  The servers
+ * placed are repacked in order of decreasing utilization when cpus come
+ * and go, see ss_place_repack().
+ */
+#define SS_PLACE_NONE		0
+#define SS_PLACE_WORST_FIT	1
+#define SS_PLACE_FIRST_FIT	2
+
+/* the cpu of @span ss fits on according to the placement policy, or -1 */
+static int __ss_place_cpu(struct sched_ss_server *ss,
+	const struct cpumask *span, int skip)
+{
+	int cpu, best = -1;
+
+	for_each_cpu_and(cpu, span, cpu_active_mask) {
+		if (cpu == skip || !ss_bw_fits_cpu(ss, cpu))
+			continue;
+
+		if (sysctl_sched_ss_placement == SS_PLACE_FIRST_FIT)
+			return cpu;
+
+		if (best < 0 || cpu_rq(cpu)->ss_bw < cpu_rq(best)->ss_bw)
+			best = cpu;
+	}
+
+	return best;
+}
+
+/*
+ * Reserve the utilization of ss on @cpus, or on a cpu of @cpus chosen by
+ * the placement policy if @place.  See ss_bw_admit().
+ */
+static int __ss_bw_admit(struct sched_ss_server *ss, const struct cpumask *cpus,
+	struct sched_ss_server *old, bool place)
+{
+	bool was_charged, old_charged = false;
+	unsigned long flags;
+	int cpu = -1;
+	bool fits;
+
+	raw_spin_lock_irqsave(&ss_bw_lock, flags);
+
+	was_charged = __ss_bw_release(ss);
+	if (old && old != ss)
+		old_charged = __ss_bw_release(old);
+
+	if (place) {
+		cpu = __ss_place_cpu(ss, cpus, -1);
+		fits = cpu >= 0 && ss_bw_fits_span(ss, cpu_active_mask);
+	} else if (cpumask_weight(cpus) == 1) {
+		cpu = cpumask_first(cpus);
+		fits = ss_bw_fits_span(ss, cpu_active_mask) &&
+		       ss_bw_fits_cpu(ss, cpu);
+	} else {
+		fits = ss_bw_fits_span(ss, cpus);
+	}
+
+	if (old_charged)
+		__ss_bw_charge(old, old->bw_cpu);
+
+	if (fits) {
+		__ss_bw_charge(ss, cpu);
+		ss->placed = place;
+	} else if (was_charged) {
+		__ss_bw_charge(ss, ss->bw_cpu);
+	}
+
+	raw_spin_unlock_irqrestore(&ss_bw_lock, flags);
+
+	return fits ? 0 : -EBUSY;
+}
+
+/**
+ * Reserve the utilization of ss on @cpus.  A server that is already
+ * charged is moved.  The server @old, which ss is about to replace, is
+ * left out of the test but keeps its charge until it is freed.
+ *
+ * @return: 0, or -EBUSY when ss does not fit.
+ */
+static int ss_bw_admit(struct sched_ss_server *ss, const struct cpumask *cpus,
+	struct sched_ss_server *old)
+{
+	return __ss_bw_admit(ss, cpus, old, false);
+}
+
+/**
+ * Admit ss as the new server of p, see ss_bw_admit().  p is placed on a
+ * cpu when the placement policy is enabled and p may run on every cpu of
+ * its root_domain; the caller pins p to ss->bw_cpu then.  The cpus p
+ * allowed itself are kept in ss->place_mask, p gets them back when ss
+ * is unplaced.  A server that replaces a placed one inherits its mask.
+ *
+ * p->pi_lock and rq->lock are held.
+ */
+static int ss_bw_admit_task(struct sched_ss_server *ss, struct task_struct *p,
+	struct sched_ss_server *old)
+{
+	const struct cpumask *mask = &p->cpus_allowed;
+#ifdef CONFIG_SMP
+	const struct cpumask *span = task_rq(p)->rd->span;
+
+	if (old && old->placed)
+		mask = &old->place_mask;
+
+	if (sysctl_sched_ss_placement != SS_PLACE_NONE &&
+	    cpumask_subset(span, mask)) {
+		cpumask_copy(&ss->place_mask, mask);
+		return __ss_bw_admit(ss, span, old, true);
+	}
+#endif
+	return ss_bw_admit(ss, mask, old);
+}
+
+static void ss_bw_release(struct sched_ss_server *ss)
+{
+	unsigned long flags;
+
+	raw_spin_lock_irqsave(&ss_bw_lock, flags);
+	__ss_bw_release(ss);
+	raw_spin_unlock_irqrestore(&ss_bw_lock, flags);
+}
+
+/* the charge of a server before sched_setaffinity() moved it */
+struct ss_bw_saved {
+	struct sched_ss_server *ss;
+	int cpu;
+	int placed;
+	bool charged;
+};
+
+/*
+ * sched_setaffinity(): the server of p is admitted again on @new_mask.
+ * Its previous charge is kept in @saved, for ss_bw_setaffinity_undo()
+ * if p can't be moved to @new_mask after all.
+ */
+static int ss_bw_setaffinity(struct task_struct *p,
+	const struct cpumask *new_mask, struct ss_bw_saved *saved)
+{
+	struct sched_ss_server *ss;
+	unsigned long flags;
+	struct rq *rq;
+	int ret = 0;
+
+	rq = task_rq_lock(p, &flags);
+	ss = saved->ss = p->rt.ss;
+	if (ss) {
+		raw_spin_lock(&ss_bw_lock);
+		saved->charged = !list_empty(&ss->bw_node);
+		saved->cpu = ss->bw_cpu;
+		saved->placed = ss->placed;
+		raw_spin_unlock(&ss_bw_lock);
+
+		ret = ss_bw_admit(ss, new_mask, NULL);
+	}
+	task_rq_unlock(rq, p, &flags);
+
+	return ret;
+}
+
+/*
+ * Put back the charge ss_bw_setaffinity() moved, set_cpus_allowed_ptr()
+ * failed.  It was admitted there before, so it is not tested again.
+ */
+static void ss_bw_setaffinity_undo(struct task_struct *p,
+	struct ss_bw_saved *saved)
+{
+	struct sched_ss_server *ss = saved->ss;
+	unsigned long flags;
+	struct rq *rq;
+
+	rq = task_rq_lock(p, &flags);
+	/* a server p got since then was admitted on its own */
+	if (ss && p->rt.ss == ss) {
+		raw_spin_lock(&ss_bw_lock);
+		__ss_bw_release(ss);
+		if (saved->charged)
+			__ss_bw_charge(ss, saved->cpu);
+		ss->placed = saved->placed;
+		raw_spin_unlock(&ss_bw_lock);
+	}
+	task_rq_unlock(rq, p, &flags);
+}
+
+/*
+ * Live reconfiguration
+ *
+ * A SCHED_SPORADIC task that only gets a new budget, replenishment period
+ * or budget bounds keeps its server: sched_setscheduler() updates it in place
+ * rather than restarting it in bg, which would cost the task the service
+ * of a whole period.  The new budget and period take effect with the next
+ * replenishment, the capacity already granted is left as it is until
+ * then.  The server stays charged for the parameters it runs with, so
+ * that its capacity never goes beyond what admission control reserved.
+ */
+
+/* could ss take the parameters of @new without being restarted? */
+static bool ss_can_retune(struct sched_ss_server *ss,
+	struct sched_ss_server *new)
+{
+	return ss->prio == new->prio &&
+	       ss->low_priority == new->low_priority &&
+	       ss->max_repl == new->max_repl &&
+	       ss->mode == new->mode &&
+	       ss->bg_policy == new->bg_policy;
+}
+
+/* does ss have, or is it about to take, the parameters of @new? */
+static bool ss_param_equal(struct sched_ss_server *ss,
+	struct sched_ss_server *new)
+{
+	bool next = ss->next_budget.tv64 != 0;
+
+	return ss_can_retune(ss, new) &&
+	       ktime_equal(next ? ss->next_budget : ss->init_budget,
+			   new->init_budget) &&
+	       ktime_equal(next ? ss->next_period : ss->repl_period,
+			   new->repl_period) &&
+	       ktime_equal(ss->ctl.min_budget, new->ctl.min_budget) &&
+	       ktime_equal(ss->ctl.max_budget, new->ctl.max_budget);
+}
+
+/*
+ * Give ss a new budget and period.  Its reservation stays where it is
+ * charged and has to fit there with the new utilization, ss is left as it
+ * was otherwise.  @cpus are the cpus of a server not pinned to one.
+ *
+ * ss_bw_lock is held, admission control reads the parameters of the
+ * servers charged.
+ *
+ * @return: true if ss was changed.
+ */
+static bool __ss_bw_resize(struct sched_ss_server *ss, ktime_t budget,
+	ktime_t period, const struct cpumask *cpus)
+{
+	ktime_t old_budget = ss->init_budget, old_period = ss->repl_period;
+	u64 old_bw = ss->bw;
+	bool charged, fits = true;
+
+	charged = __ss_bw_release(ss);
+
+	ss->init_budget = budget;
+	ss->repl_period = period;
+	ss->bw = to_ratio(ktime_to_ns(period), ktime_to_ns(budget));
+
+	if (charged && ss->bw_cpu >= 0)
+		fits = ss_bw_fits_span(ss, cpu_active_mask) &&
+		       ss_bw_fits_cpu(ss, ss->bw_cpu);
+	else if (charged)
+		fits = ss_bw_fits_span(ss, cpus);
+
+	if (!fits) {
+		ss->init_budget = old_budget;
+		ss->repl_period = old_period;
+		ss->bw = old_bw;
+	}
+
+	if (charged)
+		__ss_bw_charge(ss, ss->bw_cpu);
+
+	return fits;
+}
+
+/*
+ * Cut the capacity of ss, front and pending replenishments together, down
+ * to @budget.  The latest replenishments go first, the capacity at hand
+ * last.  Usage beyond what is left of the front is forgiven.
+ */
+static void ss_rl_trim(struct sched_ss_server *ss, ktime_t budget)
+{
+	struct sched_ss_repl *front = ss_rl_front(ss);
+	s64 excess = -ktime_to_ns(budget);
+	int i;
+
+	for (i = 0; i <= ss->nr_repl; i++)
+		excess += ktime_to_ns(ss->repl_list[ss_rl_idx(ss, i)].amt);
+
+	for (i = ss->nr_repl; i >= 0 && excess > 0; i--) {
+		struct sched_ss_repl *repl = &ss->repl_list[ss_rl_idx(ss, i)];
+		s64 cut = min(excess, ktime_to_ns(repl->amt));
+
+		repl->amt = ktime_sub_ns(repl->amt, cut);
+		excess -= cut;
+	}
+
+	if (ktime_cmp(ss->usage, front->amt) > 0)
+		ss->usage = front->amt;
+}
+
+/**
+ * A replenishment of ss arrived: the budget and period it was given by
+ * ss_retune() since the last one take effect, and it is charged for them.
+ * A sporadic server gets the difference of a larger budget added to its
+ * capacity at hand, and the capacity of a smaller one trimmed, see
+ * ss_rl_trim().  A polling or deferrable server is about to be refilled
+ * with the new budget.  Should the room have been taken since the change
+ * was asked for, the server keeps its parameters.
+ *
+ * rq->lock is held.
+ *
+ * @return: true if the new budget and period were taken.
+ */
+static bool ss_retune_apply(struct sched_ss_server *ss)
+{
+	ktime_t old_budget = ss->init_budget;
+	unsigned long flags;
+	bool fits;
+
+	if (!ss->next_budget.tv64)
+		return false;
+
+	raw_spin_lock_irqsave(&ss_bw_lock, flags);
+	fits = __ss_bw_resize(ss, ss->next_budget, ss->next_period,
+			      &ss->task->cpus_allowed);
+	raw_spin_unlock_irqrestore(&ss_bw_lock, flags);
+
+	ss->next_budget = ns_to_ktime(0);
+	ss->next_period = ns_to_ktime(0);
+
+	if (!fits) {
+		ss->ctl.nr_denied++;
+		return false;
+	}
+
+	if (ss_periodic(ss))
+		return true;
+
+	if (ktime_cmp(ss->init_budget, old_budget) > 0) {
+		struct sched_ss_repl *front = ss_rl_front(ss);
+
+		front->amt = ktime_add(front->amt,
+				       ktime_sub(ss->init_budget, old_budget));
+	} else {
+		ss_rl_trim(ss, ss->init_budget);
+	}
+
+	return true;
+}
+
+static void ss_exh_update(struct rq *rq);
+
+/**
+ * The server of p is to take the budget, period and budget bounds of @new,
+ * which must pass ss_can_retune().  See __ss_bw_resize().
+ *
+ * The budget bounds apply at once, the budget and period with the next
+ * replenishment, see ss_retune_apply().  Admission control is checked now,
+ * so that a change that cannot fit fails here.  A sporadic server with
+ * nothing consumed holds its whole budget, as right after a
+ * replenishment, so it takes the change at once.
+ *
+ * p->pi_lock and rq->lock are held.
+ *
+ * @return: 0, or -EBUSY when the new utilization does not fit.
+ */
+static int ss_retune(struct task_struct *p, struct sched_ss_server *new)
+{
+	struct sched_ss_server *ss = p->rt.ss;
+	ktime_t budget = ss->init_budget, period = ss->repl_period;
+	struct rq *rq = task_rq(p);
+	unsigned long flags;
+	bool fits;
+
+	/* tried with the new parameters, the charge stays with the old ones */
+	raw_spin_lock_irqsave(&ss_bw_lock, flags);
+	fits = __ss_bw_resize(ss, new->init_budget, new->repl_period,
+			      &p->cpus_allowed);
+	if (fits)
+		__ss_bw_resize(ss, budget, period, &p->cpus_allowed);
+	raw_spin_unlock_irqrestore(&ss_bw_lock, flags);
+
+	if (!fits)
+		return -EBUSY;
+
+	ss->ctl.min_budget = new->ctl.min_budget;
+	ss->ctl.max_budget = new->ctl.max_budget;
+
+	if (ktime_equal(new->init_budget, budget) &&
+	    ktime_equal(new->repl_period, period)) {
+		ss->next_budget = ns_to_ktime(0);
+		ss->next_period = ns_to_ktime(0);
+	} else {
+		ss->next_budget = new->init_budget;
+		ss->next_period = new->repl_period;
+	}
+
+	if (!ss_periodic(ss) && ss_rl_empty(ss) && !ss->usage.tv64 &&
+	    ss_retune_apply(ss) && task_current(rq, p))
+		ss_exh_update(rq);
+	ss_status_update(p);
+
+	return 0;
+}
+
+/*
+ * Adaptive budget
+ *
+ * At each period boundary of a polling or deferrable server with a
+ * controller, the consumption of the period that ended and whether it
+ * ended in exhaustion are folded into running averages.  A period that
+ * ran out grows the budget by a quarter.  Otherwise, while exhaustion is
+ * rarer than SS_CTL_EXH_TARGET, the budget moves a quarter of the way
+ * down to the average consumption plus a quarter of headroom.  The budget
+ * stays within the bounds given by the user and only changes if admission
+ * control lets the new utilization fit where the server is charged.
+ */
+#define SS_CTL_EXH_TARGET	50	/* per mille of the periods */
+
+/* ss reached a period boundary, rq->lock is held */
+static void ss_ctl_period(struct sched_ss_server *ss)
+{
+	struct sched_ss_ctl *ctl = &ss->ctl;
+	s64 budget = ktime_to_ns(ss->init_budget);
+	s64 min = ktime_to_ns(ctl->min_budget);
+	s64 max = ktime_to_ns(ctl->max_budget);
+	u64 runtime = ss->stats.fg_runtime;
+	unsigned long nr_exhaust = ss->stats.nr_exhaust;
+	s64 used, avg, target = budget;
+	unsigned long flags;
+	bool exhausted;
+	int rate;
+
+	if (!max)
+		return;
+
+	/* the statistics may have been reset since the last boundary */
+	used = runtime >= ctl->last_runtime ? runtime - ctl->last_runtime :
+					      runtime;
+	exhausted = nr_exhaust >= ctl->last_exhaust ?
+		    nr_exhaust > ctl->last_exhaust : nr_exhaust > 0;
+	ctl->last_runtime = runtime;
+	ctl->last_exhaust = nr_exhaust;
+
+	avg = ctl->avg_used;
+	avg += (used - avg) >> 3;
+	ctl->avg_used = avg;
+
+	rate = ctl->exh_rate;
+	rate += ((exhausted ? 1000 : 0) - rate) / 8;
+	ctl->exh_rate = rate;
+
+	if (exhausted) {
+		target = budget + (budget >> 2);
+	} else if (rate < SS_CTL_EXH_TARGET) {
+		s64 want = avg + (avg >> 2);
+
+		if (want < budget)
+			target = budget - ((budget - want) >> 2);
+	}
+	target = clamp(target, min, max);
+
+	/* small steps are not worth a pass over admission control */
+	if (target == budget || (target != min && target != max &&
+	    abs64(target - budget) < max_t(s64, budget >> 6, SS_EXH_MIN_NS)))
+		return;
+
+	raw_spin_lock_irqsave(&ss_bw_lock, flags);
+	if (__ss_bw_resize(ss, ns_to_ktime(target), ss->repl_period,
+			   &ss->task->cpus_allowed)) {
+		ctl->nr_adjust++;
+		trace_sched_ss_budget_adapt(ss, budget);
+	} else {
+		ctl->nr_denied++;
+	}
+	raw_spin_unlock_irqrestore(&ss_bw_lock, flags);
+}
+
+#ifdef CONFIG_HOTPLUG_CPU
+/* decreasing utilization */
+static int ss_bw_cmp(void *priv, struct list_head *a, struct list_head *b)
+{
+	struct sched_ss_server *sa = list_entry(a, struct sched_ss_server, bw_node);
+	struct sched_ss_server *sb = list_entry(b, struct sched_ss_server, bw_node);
+
+	if (sa->bw == sb->bw)
+		return 0;
+
+	return sa->bw < sb->bw ? 1 : -1;
+}
+
+/*
+ * Pin the tasks of the servers a repack moved to their new cpu.  A task
+ * whose server fits nowhere gets back the cpus it allowed itself.
+ */
+static void ss_place_apply(void)
+{
+	cpumask_var_t mask;
+	bool have_mask;
+
+	have_mask = alloc_cpumask_var(&mask, GFP_KERNEL);
+
+	for (;;) {
+		struct task_struct *p = NULL;
+		struct sched_ss_server *ss;
+		unsigned long flags;
+		int cpu;
+
+		raw_spin_lock_irqsave(&ss_bw_lock, flags);
+		for_each_possible_cpu(cpu) {
+			list_for_each_entry(ss, &cpu_rq(cpu)->ss_list, bw_node) {
+				if (ss->place_moved)
+					goto found;
+			}
+		}
+		list_for_each_entry(ss, &ss_unpinned_list, bw_node) {
+			if (ss->place_moved)
+				goto found;
+		}
+		raw_spin_unlock_irqrestore(&ss_bw_lock, flags);
+		break;
+found:
+		ss->place_moved = 0;
+		cpu = ss->bw_cpu;
+		p = ss->task;
+		get_task_struct(p);
+		/* ss may be freed once ss_bw_lock is dropped */
+		if (cpu < 0 && have_mask)
+			cpumask_copy(mask, &ss->place_mask);
+		raw_spin_unlock_irqrestore(&ss_bw_lock, flags);
+
+		if (cpu >= 0)
+			set_cpus_allowed_ptr(p, cpumask_of(cpu));
+		else
+			set_cpus_allowed_ptr(p, have_mask ? mask :
+							    cpu_possible_mask);
+		put_task_struct(p);
+	}
+
+	if (have_mask)
+		free_cpumask_var(mask);
+}
+
+/*
+ * Place the servers placed on cpu @off again, in order of decreasing
+ * utilization, or all of the servers placed when @off is -1.  A server
+ * that fits nowhere is charged as unpinned and may run on any cpu.
+ */
+static void ss_place_repack(int off)
+{
+	struct sched_ss_server *ss, *n;
+	unsigned long flags;
+	LIST_HEAD(list);
+	int cpu;
+
+	raw_spin_lock_irqsave(&ss_bw_lock, flags);
+
+	for_each_possible_cpu(cpu) {
+		if (off >= 0 && cpu != off)
+			continue;
+
+		list_for_each_entry_safe(ss, n, &cpu_rq(cpu)->ss_list, bw_node) {
+			if (!ss->placed)
+				continue;
+			__ss_bw_release(ss);
+			list_add(&ss->bw_node, &list);
+		}
+	}
+
+	list_sort(NULL, &list, ss_bw_cmp);
+
+	list_for_each_entry_safe(ss, n, &list, bw_node) {
+		int old_cpu = ss->bw_cpu;
+
+		list_del_init(&ss->bw_node);
+
+		cpu = __ss_place_cpu(ss, cpu_active_mask, off);
+		if (cpu < 0)
+			ss->placed = 0;
+		__ss_bw_charge(ss, cpu);
+
+		if (cpu != old_cpu)
+			ss->place_moved = 1;
+	}
+
+	raw_spin_unlock_irqrestore(&ss_bw_lock, flags);
+
+	ss_place_apply();
+}
+
+/*
+ * Repacking needs to pin tasks, which may sleep, so it is done from a cpu
+ * notifier rather than from rq_online_rt()/rq_offline_rt() under
+ * rq->lock.  Those also run when root_domains are rebuilt.  A cpu going
+ * down is already inactive, its servers move before its tasks are
+ * migrated.
+ */
+static int __cpuinit
+ss_place_cpu_notify(struct notifier_block *nb, unsigned long action, void *hcpu)
+{
+	switch (action & ~CPU_TASKS_FROZEN) {
+	case CPU_DOWN_PREPARE:
+		ss_place_repack((long)hcpu);
+		break;
+
+	case CPU_ONLINE:
+	case CPU_DOWN_FAILED:
+		ss_place_repack(-1);
+		break;
+	}
+
+	return NOTIFY_OK;
+}
+
+static int __init init_ss_place(void)
 {
-	p->ss_usage = ns_to_ktime(0);
+	hotcpu_notifier(ss_place_cpu_notify, 0);
+	return 0;
 }
+__initcall(init_ss_place);
+#endif /* CONFIG_HOTPLUG_CPU */
 
-/**
- * Assumes rq->lock is held.
+#ifdef CONFIG_PROC_FS
+/*
+ * /proc/sched_ss_bw: the reserved utilization in parts per million of a
+ * cpu, per cpu and per root_domain, next to the limit.
  */
-static void ss_budget_check(struct rq *rq, struct task_struct *p, ktime_t now, bool blocked, bool running, bool set_repl_timer)
+static inline unsigned long long ss_bw_ppm(u64 bw)
 {
-	assert_raw_spin_locked(&task_rq(p)->lock);
-
-	if (ss_out_of_budget(p, now)) {
-		ss_change_prio(rq, p, ss_bg_prio(p));
-	}
+	return (bw * 1000000) >> 20;
 }
 
-/* forward the replenishment time in interval(polling) increments */
-static int ss_fwd_repl_timer(struct task_struct *p, ktime_t now)
+static int ss_bw_show(struct seq_file *m, void *v)
 {
-	int periods = 0;
-	struct hrtimer *timer = &p->ss_repl_timer;
-	ktime_t interval = p->sched_ss_repl_period;
+	unsigned long flags;
+	int cpu;
 
-	if (ktime_cmp(hrtimer_get_expires(timer), now) > 0) {
-		/* timer already set to beginning of next period */
-		return 0;
+	raw_spin_lock_irqsave(&ss_bw_lock, flags);
+
+	seq_printf(m, "limit %llu\n", ss_bw_ppm(ss_bw_limit()));
+	seq_printf(m, "unpinned %llu\n", ss_bw_ppm(ss_unpinned_bw));
+
+	rcu_read_lock_sched();
+	for_each_online_cpu(cpu) {
+		struct rq *rq = cpu_rq(cpu);
+		const struct cpumask *span = cpu_online_mask;
+		u64 rd_bw = ss_unpinned_bw;
+		int i;
+
+#ifdef CONFIG_SMP
+		span = rq->rd->span;
+#endif
+		for_each_cpu(i, span)
+			rd_bw += cpu_rq(i)->ss_bw;
+
+		seq_printf(m, "cpu%d %llu fifo %llu root_domain %llu/%llu\n",
+			   cpu, ss_bw_ppm(rq->ss_bw), ss_bw_ppm(ss_fifo_bw(rq)),
+			   ss_bw_ppm(rd_bw),
+			   ss_bw_ppm(cpumask_weight(span) * ss_bw_limit()));
 	}
+	rcu_read_unlock_sched();
 
-	do {
-		periods++;
-		hrtimer_add_expires(timer, interval);
-	} while(ktime_cmp(hrtimer_get_expires(timer), now) <= 0);
+	raw_spin_unlock_irqrestore(&ss_bw_lock, flags);
 
-	return periods;
+	return 0;
 }
 
-/**
- * Assumes p is ready to run when called.
- *
- * @return:
- * 	- p has capacity to run now.
- */
-static bool ss_unblock_check(struct rq *rq, struct task_struct *p, ktime_t now, bool start_repl_timer, bool running)
+static int ss_bw_open(struct inode *inode, struct file *filp)
 {
-		ss_fwd_repl_timer(p, now);
+	return single_open(filp, ss_bw_show, NULL);
+}
 
-		/* activate the timer */
-		hrtimer_restart(&p->ss_repl_timer);
+static const struct file_operations ss_bw_fops = {
+	.open		= ss_bw_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
 
-		return false;
+static int __init init_ss_bw_procfs(void)
+{
+	proc_create("sched_ss_bw", 0444, NULL, &ss_bw_fops);
+	return 0;
 }
-
+__initcall(init_ss_bw_procfs);
+#endif /* CONFIG_PROC_FS */
 
 #ifdef CONFIG_RT_GROUP_SCHED
 
@@ -317,6 +1969,11 @@ static void dec_rt_migration(struct sched_rt_entity *rt_se, struct rt_rq *rt_rq)
 static void enqueue_pushable_task(struct rq *rq, struct task_struct *p)
 {
 	plist_del(&p->pushable_tasks, &rq->rt.pushable_tasks);
+
+	/* an exhausted server has nothing to run elsewhere either */
+	if (ss_task_exhausted(p))
+		return;
+
 	plist_node_init(&p->pushable_tasks, p->prio);
 	plist_add(&p->pushable_tasks, &rq->rt.pushable_tasks);
 }
@@ -474,6 +2131,16 @@ static inline struct rt_bandwidth *sched_rt_bandwidth(struct rt_rq *rt_rq)
 	return &rt_rq->tg->rt_bandwidth;
 }
 
+/* the group server running rt_rq, if any */
+static inline struct sched_ss_server *rt_rq_ss(struct rt_rq *rt_rq)
+{
+	struct sched_rt_entity *rt_se;
+
+	rt_se = rt_rq->tg->rt_se[cpu_of(rq_of_rt_rq(rt_rq))];
+
+	return rt_se ? rt_se->ss : NULL;
+}
+
 #else /* !CONFIG_RT_GROUP_SCHED */
 
 static inline u64 sched_rt_runtime(struct rt_rq *rt_rq)
@@ -541,6 +2208,11 @@ static inline struct rt_bandwidth *sched_rt_bandwidth(struct rt_rq *rt_rq)
 	return &def_rt_bandwidth;
 }
 
+static inline struct sched_ss_server *rt_rq_ss(struct rt_rq *rt_rq)
+{
+	return NULL;
+}
+
 #endif /* CONFIG_RT_GROUP_SCHED */
 
 #ifdef CONFIG_SMP
@@ -707,7 +2379,9 @@ static void __enable_runtime(struct rq *rq)
 		raw_spin_lock(&rt_rq->rt_runtime_lock);
 		rt_rq->rt_runtime = rt_b->rt_runtime;
 		rt_rq->rt_time = 0;
-		rt_rq->rt_throttled = 0;
+		/* a group server keeps its rt_rq throttled while in bg */
+		if (!rt_rq_ss(rt_rq))
+			rt_rq->rt_throttled = 0;
 		raw_spin_unlock(&rt_rq->rt_runtime_lock);
 		raw_spin_unlock(&rt_b->rt_runtime_lock);
 	}
@@ -756,6 +2430,13 @@ static int do_sched_rt_period_timer(struct rt_bandwidth *rt_b, int overrun)
 		struct rq *rq = rq_of_rt_rq(rt_rq);
 
 		raw_spin_lock(&rq->lock);
+
+		/* a group server replaces the bandwidth throttling */
+		if (rt_rq_ss(rt_rq)) {
+			raw_spin_unlock(&rq->lock);
+			continue;
+		}
+
 		if (rt_rq->rt_time) {
 			u64 runtime;
 
@@ -797,8 +2478,12 @@ static inline int rt_se_prio(struct sched_rt_entity *rt_se)
 #ifdef CONFIG_RT_GROUP_SCHED
 	struct rt_rq *rt_rq = group_rt_rq(rt_se);
 
-	if (rt_rq)
+	if (rt_rq) {
+		/* a group server is queued at its fg priority */
+		if (rt_se->ss)
+			return rt_se->ss->prio;
 		return rt_rq->highest_prio.curr;
+	}
 #endif
 
 	return rt_task_of(rt_se)->prio;
@@ -830,6 +2515,366 @@ static int sched_rt_runtime_exceeded(struct rt_rq *rt_rq)
 	return 0;
 }
 
+#ifdef CONFIG_RT_GROUP_SCHED
+/*
+ * Group servers
+ *
+ * A task group with a server configured through the cpu.rt_ss_* cgroup
+ * files runs each of its per-cpu rt_rqs as a sporadic, polling or
+ * deferrable server, in place of the rt bandwidth throttling.  While an
+ * activation is in progress the group entity is queued at the fg priority
+ * of the server.  In bg the rt_rq is throttled until capacity arrives.
+ * An activation starts when the rt_rq becomes non-empty and ends when it
+ * empties again or the budget is exhausted.
+ *
+ * All of these assume rq->lock is held.
+ */
+
+/* rq->curr runs within the group served by ss */
+static bool ss_group_running(struct rq *rq, struct sched_ss_server *ss)
+{
+	struct sched_rt_entity *rt_se;
+
+	if (rq->curr->sched_class != &rt_sched_class)
+		return false;
+
+	for (rt_se = rq->curr->rt.parent; rt_se; rt_se = rt_se->parent) {
+		if (rt_se->ss == ss)
+			return true;
+	}
+
+	return false;
+}
+
+static void ss_group_activate(struct rq *rq, struct sched_ss_server *ss,
+	ktime_t start)
+{
+	struct rt_rq *rt_rq = ss->rt_rq;
+
+	trace_sched_ss_prio_change(ss, ss->low_priority, ss->prio);
+	ss->act_time = start;
+	ss->fg = 1;
+
+	if (rt_rq->rt_throttled) {
+		rt_rq->rt_throttled = 0;
+		sched_rt_rq_enqueue(rt_rq);
+		if (ss->prio < rq->curr->prio)
+			resched_task(rq->curr);
+	}
+}
+
+/* the activation ends, the group waits in bg for its next replenishment */
+static void ss_group_deactivate(struct rq *rq, struct sched_ss_server *ss)
+{
+	struct rt_rq *rt_rq = ss->rt_rq;
+
+	trace_sched_ss_prio_change(ss, ss->prio, ss->low_priority);
+	ss_split_check(ss);
+	ss->fg = 0;
+
+	rt_rq->rt_throttled = 1;
+	if (rt_rq_throttled(rt_rq)) {
+		sched_rt_rq_dequeue(rt_rq);
+		if (ss_group_running(rq, ss))
+			resched_task(rq->curr);
+	}
+}
+
+/*
+ * Charge the group servers curr runs under.
+ *
+ * @return: true if curr runs under a group server.
+ */
+static bool ss_group_update_curr(struct rq *rq, struct task_struct *curr,
+	u64 delta_exec)
+{
+	struct sched_rt_entity *rt_se;
+	bool served = false;
+
+	for (rt_se = curr->rt.parent; rt_se; rt_se = rt_se->parent) {
+		struct sched_ss_server *ss = rt_se->ss;
+
+		if (!ss)
+			continue;
+
+		served = true;
+		if (!ss->fg) {
+			ss_stat_add(ss, bg_runtime, delta_exec);
+			continue;
+		}
+
+		ss_charge(ss, delta_exec);
+		ss_stat_add(ss, fg_runtime, delta_exec);
+		if (ss_out_of_budget(ss, ktime_get())) {
+			ss_stat_add(ss, nr_exhaust, 1);
+			trace_sched_ss_exhaust(ss);
+			ss_group_deactivate(rq, ss);
+		}
+	}
+
+	return served;
+}
+
+/*
+ * A task of the group is about to be enqueued.  Called before the enqueue,
+ * so an empty group starting an activation is queued at its fg priority.
+ */
+static void ss_group_wakeup(struct rq *rq, struct sched_rt_entity *rt_se)
+{
+	for (rt_se = rt_se->parent; rt_se; rt_se = rt_se->parent) {
+		struct sched_ss_server *ss = rt_se->ss;
+		ktime_t now;
+
+		if (!ss || ss->fg || group_rt_rq(rt_se)->rt_nr_running)
+			continue;
+
+		now = ktime_get();
+
+		if (ss_periodic(ss))
+			ss_unblock_periodic(ss, now);
+
+		if (!ss->wakeup.tv64)
+			ss->wakeup = now;
+
+		if (!ss_out_of_budget(ss, now)) {
+			ss_group_activate(rq, ss, now);
+			ss_stat_latency(ss, now);
+		}
+	}
+}
+
+/* a task of the group blocked, the groups left empty end their activation */
+static void ss_group_sleep(struct rq *rq, struct sched_rt_entity *rt_se)
+{
+	for (rt_se = rt_se->parent; rt_se; rt_se = rt_se->parent) {
+		struct sched_ss_server *ss = rt_se->ss;
+
+		if (!ss || group_rt_rq(rt_se)->rt_nr_running)
+			continue;
+
+		ss->wakeup.tv64 = 0;
+
+		if (ss_periodic(ss))
+			ss_tq_del(ss);
+
+		if (ss->fg) {
+			if (ss->mode == SS_MODE_POLLING)
+				ss->usage = ss_rl_front(ss)->amt;
+			ss_group_deactivate(rq, ss);
+		}
+	}
+}
+
+/*
+ * The earliest of @next and the exhaustion of the group servers rq->curr
+ * runs under in fg.  @now is read when first needed.
+ */
+static ktime_t ss_group_exh_next(struct rq *rq, ktime_t *now, ktime_t next)
+{
+	struct sched_rt_entity *rt_se;
+
+	for (rt_se = rq->curr->rt.parent; rt_se; rt_se = rt_se->parent) {
+		struct sched_ss_server *ss = rt_se->ss;
+		ktime_t exh;
+
+		if (!ss || !ss->fg)
+			continue;
+
+		if (!now->tv64)
+			*now = ktime_get();
+
+		exh = ktime_add(*now, ss_capacity(ss, *now));
+		if (ktime_cmp(exh, next) < 0)
+			next = exh;
+	}
+
+	return next;
+}
+
+/* the group servers rq->curr runs under that ran out of capacity */
+static void ss_group_exh(struct rq *rq, ktime_t now)
+{
+	struct sched_rt_entity *rt_se;
+
+	if (rq->curr->sched_class != &rt_sched_class)
+		return;
+
+	for (rt_se = rq->curr->rt.parent; rt_se; rt_se = rt_se->parent) {
+		struct sched_ss_server *ss = rt_se->ss;
+
+		if (!ss || !ss->fg)
+			continue;
+
+		if (!ss_exh_expire(ss, now, ss_exh_margin(rq)))
+			continue;
+
+		ss_stat_add(ss, nr_exhaust, 1);
+		trace_sched_ss_exhaust(ss);
+		ss_group_deactivate(rq, ss);
+	}
+}
+
+#else /* !CONFIG_RT_GROUP_SCHED */
+
+static inline bool ss_group_update_curr(struct rq *rq,
+	struct task_struct *curr, u64 delta_exec)
+{
+	return false;
+}
+
+static inline void ss_group_wakeup(struct rq *rq,
+	struct sched_rt_entity *rt_se)
+{
+}
+
+static inline void ss_group_sleep(struct rq *rq,
+	struct sched_rt_entity *rt_se)
+{
+}
+
+static inline ktime_t ss_group_exh_next(struct rq *rq, ktime_t *now,
+	ktime_t next)
+{
+	return next;
+}
+
+static inline void ss_group_exh(struct rq *rq, ktime_t now)
+{
+}
+
+#endif /* CONFIG_RT_GROUP_SCHED */
+
+/*
+ * Bandwidth inheritance
+ *
+ * A server that blocks on an rt_mutex in fg keeps its activation, and
+ * the lock owner it boosts runs on its budget: the runtime of the owner
+ * is charged to the donor, and once the donor runs out the boost is
+ * dropped, so that the owner does not go on at fg priority for free.
+ *
+ * The donor is blocked, so its server is serialized by its pi_lock, as
+ * in ss_repl_event().  That nests outside rq->lock, so it is only ever
+ * trylocked here; what cannot be charged right away is kept as a debt
+ * of the owner and charged on the next update.
+ */
+#ifdef CONFIG_RT_MUTEXES
+
+static inline struct task_struct *ss_pi_donor(struct task_struct *p)
+{
+	return p->rt.ss_donor;
+}
+
+/* p is about to block on an rt_mutex */
+static inline bool ss_pi_blocked(struct task_struct *p)
+{
+	return p->pi_blocked_on != NULL;
+}
+
+/*
+ * The donor of p ran out while p was boosted by it: have the boost
+ * dropped once p gets to schedule(), see ss_pi_schedule().
+ */
+static void ss_pi_exhausted(struct task_struct *p)
+{
+	p->rt.ss_donor_debt = 0;
+	p->rt.ss_donor_exhausted = 1;
+	resched_task(p);
+}
+
+/*
+ * Charge @delta of the runtime of p, rq->curr, to its donor.  A remainder
+ * of up to @slack ns is expired along with the budget.
+ */
+static void ss_pi_charge(struct rq *rq, struct task_struct *p, u64 delta,
+	s64 slack)
+{
+	struct task_struct *donor = p->rt.ss_donor;
+	struct sched_ss_server *ss;
+
+	p->rt.ss_donor_debt += delta;
+	if (p->rt.ss_donor_exhausted || !raw_spin_trylock(&donor->pi_lock))
+		return;
+
+	/* it still runs towards schedule(), or got the lock already */
+	if (donor->on_rq)
+		goto out_unlock;
+	smp_rmb();
+
+	if (donor->policy != SCHED_SPORADIC || !ss_curr_prio_fg(donor)) {
+		ss_pi_exhausted(p);
+		goto out_unlock;
+	}
+
+	ss = donor->rt.ss;
+	ss_charge(ss, p->rt.ss_donor_debt);
+	ss_stat_add(ss, fg_runtime, p->rt.ss_donor_debt);
+	ss_stat_add(ss, pi_runtime, p->rt.ss_donor_debt);
+	p->rt.ss_donor_debt = 0;
+
+	if (!ss_exh_expire(ss, ss_get_now(donor), slack))
+		goto out_unlock;
+
+	ss_stat_add(ss, nr_exhaust, 1);
+	trace_sched_ss_exhaust(ss);
+	ss_split_check(ss);
+	__ss_set_prio(donor, ss_bg_prio(donor));
+	ss_pi_exhausted(p);
+
+out_unlock:
+	raw_spin_unlock(&donor->pi_lock);
+}
+
+/* when the donor of p, rq->curr, runs out, see ss_exh_next() */
+static ktime_t ss_pi_exh_next(struct task_struct *p, ktime_t *now)
+{
+	struct task_struct *donor = p->rt.ss_donor;
+	ktime_t next = { .tv64 = KTIME_MAX };
+
+	*now = ktime_get();
+	if (p->rt.ss_donor_exhausted)
+		return next;
+
+	/* not yet chargeable, check back shortly */
+	if (!raw_spin_trylock(&donor->pi_lock))
+		return ktime_add_ns(*now, SS_TQ_RETRY_NS);
+
+	if (donor->on_rq) {
+		next = ktime_add_ns(*now, SS_TQ_RETRY_NS);
+	} else if (donor->policy == SCHED_SPORADIC && ss_curr_prio_fg(donor)) {
+		next = ktime_add(*now, ss_capacity(donor->rt.ss, *now));
+		next = ktime_sub_ns(next, p->rt.ss_donor_debt);
+	}
+	raw_spin_unlock(&donor->pi_lock);
+
+	return next;
+}
+
+#else /* !CONFIG_RT_MUTEXES */
+
+static inline struct task_struct *ss_pi_donor(struct task_struct *p)
+{
+	return NULL;
+}
+
+static inline bool ss_pi_blocked(struct task_struct *p)
+{
+	return false;
+}
+
+static inline void ss_pi_charge(struct rq *rq, struct task_struct *p,
+	u64 delta, s64 slack)
+{
+}
+
+static inline ktime_t ss_pi_exh_next(struct task_struct *p, ktime_t *now)
+{
+	ktime_t next = { .tv64 = KTIME_MAX };
+
+	return next;
+}
+
+#endif /* CONFIG_RT_MUTEXES */
+
 /*
  * Update the current task's runtime statistics. Skip current tasks that
  * are not in our scheduling class.
@@ -858,19 +2903,37 @@ static void update_curr_rt(struct rq *rq)
 
 	sched_rt_avg_update(rq, delta_exec);
 
-	if (curr->policy == SCHED_SPORADIC && ss_curr_prio_fg(curr)) {
+	if (ss_pi_donor(curr)) {
+		/* a boosted lock owner runs on the budget of its donor */
+		ss_pi_charge(rq, curr, delta_exec, 0);
+	} else if (curr->policy == SCHED_SPORADIC) {
+		struct sched_ss_server *ss = curr->rt.ss;
+
 		/* ss usage is updated only if we are consuming fg priority
 		 * time.  That is, the priority is rt_priority (fg
 		 * priority) */
-		curr->ss_usage = ktime_add_ns(curr->ss_usage, delta_exec);
+		if (ss_curr_prio_fg(curr)) {
+			ss_charge(ss, delta_exec);
+			ss_stat_add(ss, fg_runtime, delta_exec);
+		} else {
+			ss_stat_add(ss, bg_runtime, delta_exec);
+		}
+		ss_status_update(curr);
 	}
 
+	if (ss_group_update_curr(rq, curr, delta_exec) ||
+	    curr->policy == SCHED_SPORADIC)
+		sched_ss_avg_update(rq, delta_exec);
+
 	if (!rt_bandwidth_enabled())
 		return;
 
 	for_each_sched_rt_entity(rt_se) {
 		rt_rq = rt_rq_of_se(rt_se);
 
+		if (rt_rq_ss(rt_rq))
+			continue;
+
 		if (sched_rt_runtime(rt_rq) != RUNTIME_INF) {
 			raw_spin_lock(&rt_rq->rt_runtime_lock);
 			rt_rq->rt_time += delta_exec;
@@ -1131,6 +3194,52 @@ static void dequeue_rt_entity(struct sched_rt_entity *rt_se)
 	}
 }
 
+/*
+ * Change the priority of p with SS_BG_FAIR, which moves it between the rt
+ * and the fair class, as rt_mutex_setprio() does.  The rt switched_from
+ * and switched_to hooks are left out since they may drop rq->lock to pull
+ * or push tasks, and this also runs from the middle of schedule().  The
+ * fair ones keep rq->lock: switched_from_fair() normalizes the vruntime
+ * of a task leaving the fair class while asleep, so that its next
+ * enqueue_task(.flags=0) does not add min_vruntime to it a second time.
+ * What switched_to_fair() does is done below.
+ */
+static void ss_change_class(struct rq *rq, struct task_struct *p,
+	int new_prio)
+{
+	int on_rq = p->on_rq;
+	int running = task_current(rq, p);
+	const struct sched_class *prev_class = p->sched_class;
+	unsigned long flags;
+
+	if (on_rq)
+		dequeue_task(rq, p, 0);
+	if (running)
+		prev_class->put_prev_task(rq, p);
+
+	trace_sched_ss_prio_change(p->rt.ss, p->normal_prio, new_prio);
+	p->normal_prio = new_prio;
+	raw_spin_lock_irqsave(&p->pi_lock, flags);
+	p->prio = rt_mutex_getprio(p);
+	raw_spin_unlock_irqrestore(&p->pi_lock, flags);
+	ss_status_update(p);
+	p->sched_class = rt_prio(p->prio) ? &rt_sched_class : &fair_sched_class;
+
+	if (running)
+		p->sched_class->set_curr_task(rq);
+	if (on_rq)
+		enqueue_task(rq, p, 0);
+
+	if (!on_rq && prev_class == &fair_sched_class &&
+	    p->sched_class != prev_class)
+		switched_from_fair(rq, p);
+
+	if (running)
+		resched_task(p);
+	else if (on_rq)
+		check_preempt_curr(rq, p, 0);
+}
+
 /**
  * Similar to operations in __setscheduler().
  * 
@@ -1142,7 +3251,9 @@ static void dequeue_rt_entity(struct sched_rt_entity *rt_se)
  * 	- p->on_rq is a good indicator, but enqueue and dequeue only set these
  * 	  after, so be careful when using on_rq in enqueue and dequeue
  *
- * TODO: would like to allow option for bg prio/not running/etc.
+ * What p does in bg is up to its bg_policy: with SS_BG_SUSPEND it is
+ * taken off the rt_rq, with SS_BG_FAIR it moves to the fair class, see
+ * ss_change_class().
  *
  * NOTE: will not remove task from rq
  */
@@ -1158,8 +3269,8 @@ static void ss_change_prio(struct rq *rq, struct task_struct *p,
 		return;
 	}
 
-	if (p->normal_prio == new_prio) {
-		//printk(KERN_ERR "trying to set prio to the same value\n");
+	if (p->rt.ss->bg_policy == SS_BG_FAIR) {
+		ss_change_class(rq, p, new_prio);
 		return;
 	}
 
@@ -1167,10 +3278,12 @@ static void ss_change_prio(struct rq *rq, struct task_struct *p,
 		dequeue_rt_stack(&p->rt);
 	}
 	
+	trace_sched_ss_prio_change(p->rt.ss, p->normal_prio, new_prio);
 	p->normal_prio = new_prio;
 	raw_spin_lock_irqsave(&p->pi_lock, flags);
 	p->prio = rt_mutex_getprio(p);
 	raw_spin_unlock_irqrestore(&p->pi_lock, flags);
+	ss_status_update(p);
 
 	/* 
 	 * minimal dequeue/enqueue to set bit in priority array and change
@@ -1192,10 +3305,14 @@ static void ss_change_prio(struct rq *rq, struct task_struct *p,
 		 */
 		prio_changed_rt(rq, p, oldprio);
 		resched_task(rq->curr);
+
+		/* requeued at the new priority, or dropped when exhausted */
+		if (!task_current(rq, p) && p->rt.nr_cpus_allowed > 1)
+			enqueue_pushable_task(rq, p);
 	}
 
-	/* OPTION: do not execute in background */
-	if (on_rq && ss_curr_prio_bg(p)) {
+	/* SS_BG_SUSPEND: do not execute in background */
+	if (on_rq && ss_task_suspended(p)) {
 		/* remove from rq */
 		dequeue_rt_entity(&p->rt);
 		/* 
@@ -1203,57 +3320,163 @@ static void ss_change_prio(struct rq *rq, struct task_struct *p,
 		 * picked since p is removed from rq above, prio_changed_rt() will not
 		 * necessarily cause a reschedule since bg priority may be above other
 		 * tasks' priorities, but here we really want to irrevocably remove p
-		 * from the rq (TODO: may want to think about priority inheritance case)
+		 * from the rq
 		 */
 		if (task_running(rq, p))
 			resched_task(rq->curr);
 	}
 }
 
-/**
- * Handle setting and canceling the exhaust timer.
+/*
+ * Exhaustion enforcement
+ *
+ * Only the servers rq->curr runs under consume capacity, so one timer per
+ * rq covers all of them.  The timer is only ever moved earlier: switching
+ * to a task that runs out later, or that runs under no server at all,
+ * leaves it as it is and the callback then finds nothing to do.  With the
+ * SS_TICK_ENFORCE feature an exhaustion more than a tick away is left to
+ * task_tick_rt(), which arms the timer once it comes closer.
  *
- * @running:
- * 	- TODO: probably should be named set_timer
- * 	- sets/cancels timer based if true/false
+ * Usage is charged from rq->clock_task, so at expiry the callback checks
+ * what capacity is really left rather than trusting the timer: more than
+ * ss_exh_margin() left re-arms it.  The timer is armed early by its
+ * average latency, and whatever still runs past the budget is an overrun
+ * taken off the next replenishment, see ss_split_check().
+ *
+ * All of these assume rq->lock is held.
+ */
+
+/*
+ * When the first of the servers rq->curr runs under in fg runs out of
+ * capacity, KTIME_MAX if there are none.  @now is read when first needed.
  */
-static void ss_do_exh_timer(struct rq *rq, struct task_struct *p, ktime_t now, bool running)
+static ktime_t ss_exh_next(struct rq *rq, ktime_t *now)
+{
+	struct task_struct *curr = rq->curr;
+	ktime_t next = { .tv64 = KTIME_MAX };
+
+	if (curr->sched_class != &rt_sched_class)
+		return next;
+
+	if (ss_pi_donor(curr)) {
+		next = ss_pi_exh_next(curr, now);
+	} else if (curr->policy == SCHED_SPORADIC && ss_curr_prio_fg(curr)) {
+		*now = ktime_get();
+		next = ktime_add(*now, ss_capacity(curr->rt.ss, *now));
+	}
+
+	return ss_group_exh_next(rq, now, next);
+}
+
+static void ss_exh_update(struct rq *rq)
 {
-	ktime_t budget = ss_capacity(p, now);
+	struct hrtimer *timer = &rq->ss_exh_timer;
+	ktime_t now = { .tv64 = 0 };
+	ktime_t next = ss_exh_next(rq, &now);
+
+	if (next.tv64 == KTIME_MAX)
+		return;
+
+	if (sched_feat(SS_TICK_ENFORCE) &&
+	    ktime_to_ns(ktime_sub(next, now)) > TICK_NSEC)
+		return;
 
-	if (!running) {
-		/* p was previously running, but is no longer,
-		 * no need for exh timer */
-		WARN_ON_ONCE(hrtimer_try_to_cancel(&p->ss_exh_timer) == -1);
+	next = ktime_sub_ns(next, rq->ss_exh_lat);
 
+	/* a callback waiting for rq->lock re-arms the timer itself */
+	if (hrtimer_active(timer) &&
+	    ktime_cmp(hrtimer_get_softexpires(timer), next) <= 0)
 		return;
+
+	ss_start_timer(rq, timer, next, 0);
+}
+
+#ifdef CONFIG_SMP
+/* called from hardirq (IPI) context, see ss_start_timer() */
+static void __ss_exh_update(void *arg)
+{
+	struct rq *rq = arg;
+
+	raw_spin_lock(&rq->lock);
+	rq->ss_exh_csd_pending = 0;
+	ss_exh_update(rq);
+	raw_spin_unlock(&rq->lock);
+}
+#endif
+
+/* tick based enforcement, see above */
+static void ss_exh_tick(struct rq *rq, struct task_struct *p)
+{
+	/* group servers are checked in update_curr_rt() */
+	if (p->policy == SCHED_SPORADIC)
+		ss_budget_check(rq, p, ss_get_now(p));
+
+	ss_exh_update(rq);
+}
+
+#ifdef CONFIG_RT_MUTEXES
+/*
+ * The boost of p now comes from @donor, NULL if none.  Runtime up to now
+ * is charged to the previous donor, which is returned to be released by
+ * the caller once rq->lock is dropped.
+ *
+ * p->pi_lock and rq->lock are held.
+ */
+static struct task_struct *ss_pi_set_donor(struct rq *rq,
+	struct task_struct *p, struct task_struct *donor)
+{
+	struct task_struct *old = p->rt.ss_donor;
+
+	if (donor == old)
+		return NULL;
+
+	if (task_current(rq, p)) {
+		update_rq_clock(rq);
+		update_curr_rt(rq);
 	}
 
-	if (running) {
-		ktime_t timer_exp = ktime_add(now, budget);
+	if (donor)
+		get_task_struct(donor);
+	p->rt.ss_donor = donor;
+	p->rt.ss_donor_debt = 0;
+	p->rt.ss_donor_exhausted = 0;
 
-		if (ss_out_of_budget(p, now)) {
-			printk(KERN_ERR "running task with no budget\n");
-		}
+	if (task_current(rq, p))
+		ss_exh_update(rq);
 
-		if (ktime_cmp(timer_exp, ss_get_now(p)) <= 0) {
-			printk(KERN_ERR "setting exhaust timer to expire in the past\n");
-		}
+	return old;
+}
 
-		if (ktime_cmp(timer_exp, hrtimer_get_expires(&p->ss_repl_timer)) > 0) {
-			printk(KERN_ERR "expiration time greater than replenishment (overloaded?)\n");
-		} else {
-			if (!ss_curr_prio_bg(p)) {
-				/* only set exhaust timer if it is < repl timer */
-				/* TODO: make sure repl timer is set! */
-				WARN_ON_ONCE(hrtimer_start(&p->ss_exh_timer,
-					timer_exp, HRTIMER_MODE_ABS));
-			}
-		}
+/*
+ * Called by schedule() for the task it returns to, without locks held:
+ * drops the boost a task got from a donor that ran out meanwhile, by
+ * passing the new priority of the donor down the lock chain.
+ */
+static void ss_pi_schedule(struct task_struct *p)
+{
+	struct task_struct *donor;
+	unsigned long flags;
 
+	if (likely(!p->rt.ss_donor_exhausted))
 		return;
+
+	raw_spin_lock_irqsave(&p->pi_lock, flags);
+	p->rt.ss_donor_exhausted = 0;
+	donor = p->rt.ss_donor;
+	if (donor)
+		get_task_struct(donor);
+	raw_spin_unlock_irqrestore(&p->pi_lock, flags);
+
+	if (donor) {
+		rt_mutex_adjust_pi(donor);
+		put_task_struct(donor);
 	}
 }
+#else
+static inline void ss_pi_schedule(struct task_struct *p)
+{
+}
+#endif /* CONFIG_RT_MUTEXES */
 
 /**
  * A context switch is about to occur.
@@ -1265,37 +3488,76 @@ static void ss_do_exh_timer(struct rq *rq, struct task_struct *p, ktime_t now, b
 static void cs_notify_rt(struct rq *rq, struct task_struct *prev,
               struct task_struct *next)
 {
-	/* arm exhaust timer to minimize overrun */
-	if (next->policy == SCHED_SPORADIC) {
-		ss_do_exh_timer(rq, next, ss_get_now(next), true);
+	if (prev->policy == SCHED_SPORADIC) {
+		/* preemption does not end the activation, exhaustion does */
+		ss_budget_check(rq, prev, ss_get_now(prev));
 	}
 
-	if (prev->policy == SCHED_SPORADIC) {
-		ktime_t now = ss_get_now(prev);
+	if (next->policy == SCHED_SPORADIC && ss_curr_prio_fg(next) &&
+	    ss_out_of_budget(next->rt.ss, ss_get_now(next)))
+		ss_stat_add(next->rt.ss, nr_nobudget, 1);
 
-		/* TODO: !prev->on_rq or false */
-		ss_budget_check(rq, prev, now, !prev->on_rq, false, true);
-		ss_do_exh_timer(rq, prev, now, false);
-	}
+	ss_exh_update(rq);
 }
 
 /*
  * Adding/removing a task to/from a priority array:
  */
+/*
+ * Called by enqueue_task() for a SCHED_SPORADIC p, whatever its class.
+ *
+ * A ready server with capacity runs at fg priority right away, so an
+ * aperiodic request does not wait for the next replenishment.  Done
+ * before the enqueue so p is queued at its new priority, and in its
+ * new class: an SS_BG_FAIR server changes class here unless it runs,
+ * its class then was set by ss_change_class() already.
+ */
+static void ss_enqueue_task(struct rq *rq, struct task_struct *p, int flags)
+{
+	struct sched_ss_server *ss = p->rt.ss;
+	ktime_t now = ss_get_now(p);
+	int running = task_current(rq, p);
+
+	if (ss_periodic(ss))
+		ss_unblock_periodic(ss, now);
+
+	if ((flags & ENQUEUE_WAKEUP) && !ss->wakeup.tv64)
+		ss->wakeup = now;
+
+	if (ss_curr_prio_bg(p) &&
+	    (!running || p->sched_class == &rt_sched_class) &&
+	    ss_unblock_check(p, now)) {
+		__ss_set_prio(p, ss_fg_prio(p));
+		ss_stat_latency(ss, now);
+
+		/* exh timer set in cs_notify, unless we already run */
+		if (running)
+			ss_exh_update(rq);
+	}
+
+	if (running || rt_prio(p->prio) == (p->sched_class == &rt_sched_class))
+		return;
+
+	if (rt_prio(p->prio)) {
+		/* a wakeup without task_waking_fair() leaves vruntime as is */
+		if ((flags & (ENQUEUE_WAKEUP | ENQUEUE_WAKING)) == ENQUEUE_WAKEUP)
+			fair_sched_class.switched_from(rq, p);
+		p->sched_class = &rt_sched_class;
+	} else {
+		p->sched_class = &fair_sched_class;
+	}
+}
+
 static void
 enqueue_task_rt(struct rq *rq, struct task_struct *p, int flags)
 {
 	struct sched_rt_entity *rt_se;
 
-	if (p->policy == SCHED_SPORADIC) {
-		bool running = task_running(rq, p);
-
-		/* sets repl timer, exh timer set in cs_notify */
-		ss_unblock_check(rq, p, ss_get_now(p), true, running);
-
-		if (!ss_curr_prio_bg(p)) {
-			printk(KERN_ERR "enqueued but not at bg prio, but should be\n");
-		}
+	/* waits for its replenishment off the rt_rq, see ss_change_prio() */
+	if (ss_task_suspended(p)) {
+		if (task_current(rq, p))
+			resched_task(p);
+		return;
 	}
 
 	rt_se = &p->rt;
@@ -1303,6 +3565,8 @@ enqueue_task_rt(struct rq *rq, struct task_struct *p, int flags)
 	if (flags & ENQUEUE_WAKEUP)
 		rt_se->timeout = 0;
 
+	ss_group_wakeup(rq, rt_se);
+
 	enqueue_rt_entity(rt_se, flags & ENQUEUE_HEAD);
 
 	if (!task_current(rq, p) && p->rt.nr_cpus_allowed > 1)
@@ -1312,51 +3576,44 @@ enqueue_task_rt(struct rq *rq, struct task_struct *p, int flags)
 
 static void dequeue_task_rt(struct rq *rq, struct task_struct *p, int flags)
 {
-	struct sched_rt_entity *rt_se;
-
-	/* 
-	 * place here so p->on_rq is consistent, that is before we actually
-	 * dequeue, so any functions called can use p->on_rq and it will be
-	 * accurate.  p->on_rq will be set after this function.
-	 */
-	if (p->policy == SCHED_SPORADIC) {
-		ktime_t now = ss_get_now(p);
+	struct sched_rt_entity *rt_se = &p->rt;
 
-		/*
-		 * exh timer should have been active if we are running in fg
-		 * Possibly we could have been dequeued but exhaust timer came before
-		 * rq->lock obtained on dequeue path through kernel
-		 */
-		/* TODO: only warn if in fg, and we allow bg execution */
-		WARN_ON_ONCE(!hrtimer_active(&p->ss_exh_timer));
+	update_curr_rt(rq);
+	dequeue_rt_entity(rt_se);
 
- 		/* can't use hrtimer_cancel here because we are holding rq->lock */
-		WARN_ON_ONCE(hrtimer_try_to_cancel(&p->ss_exh_timer) == -1);
+	dequeue_pushable_task(rq, p);
 
-		/* replenishment timer should only be deactivated by a dequeue, so make
-		 * sure it is active before we cancel it */
-		WARN_ON_ONCE(!hrtimer_active(&p->ss_repl_timer));
+	/*
+	 * Blocking ends the fg activation: charge what was consumed and keep
+	 * the remaining capacity, except for a polling server which forfeits
+	 * it.  Done after the dequeue so the priority can change without
+	 * touching the rt_rq.  Other dequeues (migration, priority or policy
+	 * changes) do not end the activation, nor does blocking on an
+	 * rt_mutex, since the owner then runs on the budget of p.  The class
+	 * of an SS_BG_FAIR server is switched when it wakes up again.
+	 */
+	if (p->policy == SCHED_SPORADIC && (flags & DEQUEUE_SLEEP) &&
+	    !ss_pi_blocked(p)) {
+		struct sched_ss_server *ss = p->rt.ss;
 
-		/* 
-		 * TODO: if repl_timer is not canceled, task_struct could go away
-		 * taking timer along with it (oops when timer is dereferenced at
-		 * expiration).  If we can't cancel it here better make sure it is
-		 * canceled before deallocation of task_struct
-		 */
-		WARN_ON_ONCE(hrtimer_try_to_cancel(&p->ss_repl_timer) == -1);
+		ss->wakeup.tv64 = 0;
 
-		ss_change_prio(rq, p, ss_bg_prio(p));
+		/* period boundaries are caught up on in ss_unblock_periodic() */
+		if (ss_periodic(ss))
+			ss_tq_del(ss);
 
-		/* expire budget */
-		p->ss_usage = p->ss_repl_list[p->repl_head].amt;
+		if (ss_curr_prio_fg(p)) {
+			if (ss->mode == SS_MODE_POLLING) {
+				ss_slack_give(rq, ss, ss_get_now(p));
+				ss->usage = ss_rl_front(ss)->amt;
+			}
+			ss_split_check(ss);
+			__ss_set_prio(p, ss_bg_prio(p));
+		}
 	}
 
-	rt_se = &p->rt;
-
-	update_curr_rt(rq);
-	dequeue_rt_entity(rt_se);
-
-	dequeue_pushable_task(rq, p);
+	if (flags & DEQUEUE_SLEEP)
+		ss_group_sleep(rq, rt_se);
 }
 
 /*
@@ -1499,110 +3756,352 @@ static void check_preempt_curr_rt(struct rq *rq, struct task_struct *p, int flag
 #endif
 }
 
-static enum hrtimer_restart ss_repl_cb(struct hrtimer *timer)
+#ifdef CONFIG_RT_GROUP_SCHED
+/* the server was replaced or removed while a callback waited for rq->lock */
+static inline bool ss_group_stale(struct sched_ss_server *ss)
 {
-	struct task_struct *p;
-	struct rq *rq;
-	int periods_passed;
-	ktime_t now;
-	bool running;
+	struct rt_rq *rt_rq = ss->rt_rq;
 
-	//printk(KERN_ERR "%s\n", __func__);
+	return rt_rq_ss(rt_rq) != ss;
+}
 
-	p = container_of(timer, struct task_struct, ss_repl_timer);
-	rq = task_rq(p);
-	
-	raw_spin_lock(&rq->lock);
+/**
+ * Install @ss as the server of the rt_rq of @tg on @cpu, or remove the
+ * server when @ss is NULL.  A group with tasks queued starts a fg
+ * activation right away, an empty one waits in bg.
+ *
+ * rq->lock is held.  The old server is returned, to be freed by the caller
+ * once rq->lock is dropped.
+ */
+static struct sched_ss_server *
+ss_group_set_server(struct task_group *tg, int cpu, struct sched_ss_server *ss)
+{
+	struct sched_rt_entity *rt_se = tg->rt_se[cpu];
+	struct rt_rq *rt_rq = tg->rt_rq[cpu];
+	struct sched_ss_server *old = rt_se->ss;
 
-	update_rq_clock(rq);
-	update_curr_rt(rq);
+	/* the priority of the group entity changes */
+	dequeue_rt_stack(rt_se);
+
+	if (old)
+		ss_repl_stop(old);
+
+	raw_spin_lock(&rt_rq->rt_runtime_lock);
+	rt_rq->rt_time = 0;
+	rt_rq->rt_throttled = 0;
+	raw_spin_unlock(&rt_rq->rt_runtime_lock);
 
-	running = task_running(rq, p);
+	rt_se->ss = ss;
+	if (ss) {
+		ktime_t now = ktime_get();
 
-	/* exh timer may be active if task was preempted for a long time */
-	if (ktime_cmp(p->ss_usage, p->sched_ss_init_budget) > 0) {
-		ktime_t budget = ktime_sub(p->sched_ss_init_budget, p->ss_usage);
+		ss->rt_rq = rt_rq;
+		ss_reset_server(ss, now);
 
-		/* -5000 is just a fudge factor */
-		if (budget.tv64 < -5000) {
-			printk(KERN_ERR "budget overrun: %lld\n", (u64)budget.tv64);
+		if (rt_rq->rt_nr_running) {
+			ss->act_time = now;
+			ss->fg = 1;
+			if (ss_periodic(ss))
+				ss_tq_add(ss, cpu_rq(cpu), ss->repl_expires);
+		} else {
+			ss->fg = 0;
+			rt_rq->rt_throttled = 1;
 		}
-		WARN_ON(hrtimer_active(&p->ss_exh_timer));
 	}
 
-	/* exh timer may be active if task was preempted for a long time */
-	if (hrtimer_try_to_cancel(&p->ss_exh_timer) != 0) {
-		printk(KERN_ERR "exh timer active in ss_repl_cb(), probably overloaded (full budget not received)\n");
+	for_each_sched_rt_entity(rt_se)
+		__enqueue_rt_entity(rt_se, false);
+
+	resched_task(cpu_rq(cpu)->curr);
+	ss_exh_update(cpu_rq(cpu));
+
+	return old;
+}
+
+/* ss is due on the timer queue of its rq, rq->lock is held */
+static void ss_group_repl(struct rq *rq, struct sched_ss_server *ss,
+	ktime_t now)
+{
+	struct rt_rq *rt_rq = ss->rt_rq;
+
+	if (ss_group_stale(ss))
+		return;
+
+	if (ss_periodic(ss)) {
+		bool ready = ss->fg || rt_rq->rt_nr_running;
+
+		ss_period_skip_check(ss, ss_period_boundary(ss, now, ready));
+	} else if (!ss_rl_merge(ss, now)) {
+		goto out_arm;
 	}
+	ss_stat_add(ss, nr_repl, 1);
+	trace_sched_ss_replenish(ss);
 
-	/* replenishment arrived, set usage to zero */
-	p->ss_usage = ns_to_ktime(0);
+	/* as for a task, a new activation starts when the capacity was due */
+	if (!ss->fg && rt_rq->rt_nr_running && !ss_out_of_budget(ss, now)) {
+		ss_group_activate(rq, ss, ss_rl_front(ss)->time);
+		ss_stat_latency(ss, now);
+	}
 
-	periods_passed = ss_fwd_repl_timer(p, hrtimer_get_expires(timer));
+	if (ss->fg && ss_group_running(rq, ss))
+		ss_exh_update(rq);
 
-	/* handles skipped periods */
-	/* now is relative to start of previous period, prevents drift */
-	now = ktime_sub(hrtimer_get_expires(timer), p->sched_ss_repl_period);
+out_arm:
+	ss_arm_repl_timer(ss);
+}
+#endif /* CONFIG_RT_GROUP_SCHED */
 
-	if (ktime_cmp(now, ns_to_ktime(0)) == -1)
-		printk(KERN_ERR "SCHED_SPORADIC: negative now\n");
+/* the server of p is due on the timer queue of rq, rq->lock is held */
+static void ss_task_repl(struct rq *rq, struct task_struct *p, ktime_t now)
+{
+	struct sched_ss_server *ss = p->rt.ss;
 
-	if (periods_passed != 1)
-		printk(KERN_ERR "SCHED_SPORADIC: replenishment timer skipped a period\n");
+	if (ss_periodic(ss))
+		ss_period_skip_check(ss, ss_period_boundary(ss, now, p->on_rq));
+	else if (!ss_rl_merge(ss, now))
+		goto out_arm;
+	ss_stat_add(ss, nr_repl, 1);
+	trace_sched_ss_replenish(ss);
 
-	/* even if taken of rt runqueue, on_rq will be 1 and ss_change_prio will
-	 * return p to the rt runqueue */
-	/* exhaust timer will be set when task is context switched to run */
-	ss_change_prio(rq, p, ss_fg_prio(p));
+	/*
+	 * A ready server in bg starts a new fg activation at the time the
+	 * replenishment was due, which prevents drift.  If p is already in
+	 * fg, its activation continues with the added capacity.
+	 *
+	 * Even if taken off the rt runqueue, on_rq will be 1 and
+	 * ss_change_prio will return p to the rt runqueue.
+	 */
+	if (p->on_rq && ss_curr_prio_bg(p) && !ss_out_of_budget(ss, now)) {
+		ss->act_time = ss_rl_front(ss)->time;
+		ss_change_prio(rq, p, ss_fg_prio(p));
+		ss_stat_latency(ss, now);
+	}
 
 	/* 
-	 * HOWEVER, if we are already running, we will not be context switched
-	 * in so set exhaust timer
+	 * exhaust timer will be set when task is context switched to run,
+	 * HOWEVER, if we are already running, set it here
 	 */
+	if (task_running(rq, p))
+		ss_exh_update(rq);
 
-	if (running)
-		ss_do_exh_timer(rq, p, now, running);
-	
-	raw_spin_unlock(&rq->lock);
+	ss_status_update(p);
+
+out_arm:
+	ss_arm_repl_timer(ss);
+}
+
+/*
+ * ss was taken off the timer queue of rq, to expire at @expires.  Its
+ * task may have moved to another cpu since it was queued; the server is
+ * then passed on to the queue there.
+ */
+static void ss_repl_event(struct rq *rq, struct sched_ss_server *ss,
+	ktime_t expires, ktime_t now)
+{
+	struct task_struct *p = ss->task;
+	struct rq *p_rq;
+
+#ifdef CONFIG_RT_GROUP_SCHED
+	if (!p) {
+		ss_group_repl(rq, ss, now);
+		return;
+	}
+#endif
+	/* p may have left SCHED_SPORADIC or got a new server meanwhile */
+	if (p->rt.ss != ss)
+		return;
 
-	/* TODO: we may have tried to cancel timer elsewhere, but failed since
-	 * timer cb was running.  Maybe check if on rq? */
+	/* a queued p only moves with rq->lock held */
+	if (p->on_rq) {
+		smp_rmb();
+		if (task_rq(p) == rq) {
+			ss_task_repl(rq, p, now);
+			return;
+		}
+	} else if (raw_spin_trylock(&p->pi_lock)) {
+		/*
+		 * A blocked p moves when it is woken up, under p->pi_lock.
+		 * That nests outside rq->lock, hence the trylock.
+		 */
+		if (task_rq(p) == rq && p->rt.ss == ss) {
+			ss_task_repl(rq, p, now);
+			raw_spin_unlock(&p->pi_lock);
+			return;
+		}
+		raw_spin_unlock(&p->pi_lock);
+	}
 
-	return HRTIMER_RESTART;
+	/*
+	 * p moved, or a wakeup holding p->pi_lock waits for rq->lock.  In
+	 * the latter case try again shortly rather than right away.
+	 */
+	p_rq = task_rq(p);
+	if (p_rq == rq)
+		expires = ktime_add_ns(now, SS_TQ_RETRY_NS);
+	ss_tq_add(ss, p_rq, expires);
 }
 
-static enum hrtimer_restart ss_exh_cb(struct hrtimer *timer)
+/*
+ * Expiry of the replenishment timer queue of rq.  All the servers due are
+ * handled under one acquisition of rq->lock.
+ */
+static enum hrtimer_restart ss_tq_timer_cb(struct hrtimer *timer)
 {
-	struct task_struct *p;
-	struct rq *rq;
-    ktime_t now;
+	struct rq *rq = container_of(timer, struct rq, ss_timer);
+	struct timerqueue_node *next;
+	ktime_t now;
 
-	p = container_of(timer, struct task_struct, ss_exh_timer);
-	rq = task_rq(p);
-	
 	raw_spin_lock(&rq->lock);
 
-	now = ss_get_now(p);
-
 	update_rq_clock(rq);
 	update_curr_rt(rq);
 
-	/* if p has budget, exh timer should not expire */
-	if (!ss_out_of_budget(p, now)) {
-		ktime_t budget = ktime_sub(p->sched_ss_init_budget, p->ss_usage);
+	now = hrtimer_cb_get_time(timer);
 
-		if (budget.tv64 < -3000) {
-			printk(KERN_ERR "exh timer expired with budget remaining: %lld\n", (u64)budget.tv64);
+	/* servers are freed after a grace period, see ss_free_server() */
+	rcu_read_lock();
+	for (;;) {
+		struct sched_ss_server *ss;
+		ktime_t expires;
+
+		raw_spin_lock(&rq->ss_tq_lock);
+		next = timerqueue_getnext(&rq->ss_tq);
+		if (!next || ktime_cmp(next->expires, now) > 0) {
+			ss_tq_program(rq);
+			raw_spin_unlock(&rq->ss_tq_lock);
+			break;
 		}
+		timerqueue_del(&rq->ss_tq, next);
+		ss = container_of(next, struct sched_ss_server, repl_node);
+		ss->repl_rq = NULL;
+		expires = next->expires;
+		raw_spin_unlock(&rq->ss_tq_lock);
+
+		ss_repl_event(rq, ss, expires, now);
+	}
+	rcu_read_unlock();
+
+	raw_spin_unlock(&rq->lock);
+
+	/* re-armed from ss_tq_program(), servers may be queued meanwhile */
+	return HRTIMER_NORESTART;
+}
+
+/*
+ * Exhaustion timer of rq: the servers rq->curr runs under that are out of
+ * capacity end their fg activation.
+ */
+static enum hrtimer_restart ss_exh_timer_cb(struct hrtimer *timer)
+{
+	struct rq *rq = container_of(timer, struct rq, ss_exh_timer);
+	struct task_struct *p;
+	ktime_t now;
+	s64 late;
+
+	raw_spin_lock(&rq->lock);
+
+	update_rq_clock(rq);
+	update_curr_rt(rq);
+
+	now = hrtimer_cb_get_time(timer);
+	p = rq->curr;
+
+	/* how late did we fire, averaged over the last few expiries */
+	late = ktime_to_ns(ktime_sub(now, hrtimer_get_expires(timer)));
+	late = clamp_t(s64, late, 0, SS_EXH_LAT_MAX_NS);
+	rq->ss_exh_lat += (late - rq->ss_exh_lat) / 8;
+
+	if (ss_pi_donor(p)) {
+		ss_pi_charge(rq, p, 0, ss_exh_margin(rq));
+		goto groups;
 	}
 
+	if (p->policy != SCHED_SPORADIC || !ss_curr_prio_fg(p))
+		goto groups;
+
+	/*
+	 * The usage was just brought up to date, so more capacity than the
+	 * margin left means the timer went off early or capacity was added
+	 * since it was set: ss_exh_update() below re-arms it.
+	 */
+	if (!ss_exh_expire(p->rt.ss, now, ss_exh_margin(rq)))
+		goto groups;
+	if (ss_slack_take(rq, p->rt.ss, now))
+		goto groups;
+
+	ss_stat_add(p->rt.ss, nr_exhaust, 1);
+	trace_sched_ss_exhaust(p->rt.ss);
+	ss_split_check(p->rt.ss);
 	ss_change_prio(rq, p, ss_bg_prio(p));
 
+groups:
+	ss_group_exh(rq, now);
+	ss_exh_update(rq);
+
 	raw_spin_unlock(&rq->lock);
 
 	return HRTIMER_NORESTART;
 }
 
+/*
+ * p, rq->curr, completed its job, which took @exec_runtime in total since
+ * the previous one.  The rest of its capacity is given up, to the slack
+ * pool as when a polling server blocks, and p continues in bg until its
+ * next replenishment, which also brings back what it gave up.  The fg
+ * activation ends as it does at exhaustion, without counting as one.
+ *
+ * rq->lock is held.
+ */
+static void ss_job_complete(struct rq *rq, struct task_struct *p,
+	u64 exec_runtime)
+{
+	struct sched_ss_server *ss = p->rt.ss;
+	u64 runtime = exec_runtime - ss->job_start;
+
+	update_curr_rt(rq);
+
+	ss->job_start = exec_runtime;
+	ss_stat_add(ss, nr_jobs, 1);
+	ss_stat_add(ss, job_runtime_sum, runtime);
+	ss_stat_max(ss, job_runtime_max, runtime);
+	trace_sched_ss_job_complete(ss, runtime);
+
+	if (!ss_curr_prio_fg(p))
+		return;
+
+	ss_slack_give(rq, ss, ss_get_now(p));
+	ss->usage = ss_rl_front(ss)->amt;
+	ss_split_check(ss);
+	ss_change_prio(rq, p, ss_bg_prio(p));
+}
+
+static void init_ss_rq(struct rq *rq)
+{
+	raw_spin_lock_init(&rq->ss_tq_lock);
+	timerqueue_init_head(&rq->ss_tq);
+	hrtimer_init(&rq->ss_timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+	rq->ss_timer.function = ss_tq_timer_cb;
+
+	hrtimer_init(&rq->ss_exh_timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+	rq->ss_exh_timer.function = ss_exh_timer_cb;
+	rq->ss_exh_lat = 0;
+
+#ifdef CONFIG_SMP
+	rq->ss_tq_csd_pending = 0;
+	rq->ss_tq_csd.flags = 0;
+	rq->ss_tq_csd.func = __ss_tq_program;
+	rq->ss_tq_csd.info = rq;
+
+	rq->ss_exh_csd_pending = 0;
+	rq->ss_exh_csd.flags = 0;
+	rq->ss_exh_csd.func = __ss_exh_update;
+	rq->ss_exh_csd.info = rq;
+#endif
+
+	rq->ss_slack = 0;
+	rq->ss_slack_expires = ktime_set(0, 0);
+}
+
 static struct sched_rt_entity *pick_next_rt_entity(struct rq *rq,
 						   struct rt_rq *rt_rq)
 {
@@ -1696,7 +4195,7 @@ static int pick_rt_task(struct rq *rq, struct task_struct *p, int cpu)
 {
 	if (!task_running(rq, p) &&
 	    (cpu < 0 || cpumask_test_cpu(cpu, &p->cpus_allowed)) &&
-	    (p->rt.nr_cpus_allowed > 1))
+	    (p->rt.nr_cpus_allowed > 1) && !ss_task_exhausted(p))
 		return 1;
 	return 0;
 }
@@ -1741,6 +4240,31 @@ next_idx:
 
 static DEFINE_PER_CPU(cpumask_var_t, local_cpu_mask);
 
+/*
+ * Among the cpus in @lowest_mask, keep those whose pinned servers leave
+ * room for the reservation of the server of p, if there are any.  The
+ * totals are read without ss_bw_lock, this is only a hint.
+ */
+static void ss_prefer_reserved(struct task_struct *p,
+	struct cpumask *lowest_mask)
+{
+	u64 bw = p->rt.ss->bw, limit = ss_bw_limit();
+	int cpu, room = 0;
+
+	for_each_cpu(cpu, lowest_mask) {
+		if (ACCESS_ONCE(cpu_rq(cpu)->ss_bw) + bw <= limit)
+			room++;
+	}
+
+	if (!room || room == cpumask_weight(lowest_mask))
+		return;
+
+	for_each_cpu(cpu, lowest_mask) {
+		if (ACCESS_ONCE(cpu_rq(cpu)->ss_bw) + bw > limit)
+			cpumask_clear_cpu(cpu, lowest_mask);
+	}
+}
+
 static int find_lowest_rq(struct task_struct *task)
 {
 	struct sched_domain *sd;
@@ -1758,6 +4282,9 @@ static int find_lowest_rq(struct task_struct *task)
 	if (!cpupri_find(&task_rq(task)->rd->cpupri, task, lowest_mask))
 		return -1; /* No targets found */
 
+	if (task->policy == SCHED_SPORADIC)
+		ss_prefer_reserved(task, lowest_mask);
+
 	/*
 	 * At this point we have built a mask of cpus representing the
 	 * lowest priority tasks in the system.  Now we want to elect
@@ -2269,6 +4796,9 @@ static void task_tick_rt(struct rq *rq, struct task_struct *p, int queued)
 {
 	update_curr_rt(rq);
 
+	if (sched_feat(SS_TICK_ENFORCE))
+		ss_exh_tick(rq, p);
+
 	watchdog(rq, p);
 
 	/*
@@ -2361,3 +4891,85 @@ static void print_rt_stats(struct seq_file *m, int cpu)
 }
 #endif /* CONFIG_SCHED_DEBUG */
 
+
+#ifdef CONFIG_TEST_SCHED_SPORADIC
+/*
+ * A server with a 10ms budget runs out, draws 5ms of slack, runs 2ms of
+ * it and blocks: its 10ms are replenished, and the 3ms of slack left are
+ * neither kept as capacity nor passed on.  The slack pool and statistics
+ * of the rq are put back as they were.
+ */
+static int __init ss_slack_test(void)
+{
+	struct sched_param param = {
+		.sched_priority = 1,
+		.sched_ss_repl_period = { 0, 100 * NSEC_PER_MSEC },
+		.sched_ss_init_budget = { 0, 10 * NSEC_PER_MSEC },
+		.sched_ss_max_repl = 4,
+		.sched_ss_mode = SS_MODE_SPORADIC,
+	};
+	struct sched_ss_stats stats;
+	struct sched_ss_server *ss;
+	ktime_t slack_expires, now;
+	int slack_prio, err = 0;
+	u64 slack;
+	struct rq *rq;
+
+	if (!sched_feat(SS_RECLAIM))
+		return 0;
+
+	ss = ss_alloc_server(current, &param);
+	if (!ss)
+		return -ENOMEM;
+
+	rq = this_rq_lock();
+	stats = rq->ss_stats;
+	slack = rq->ss_slack;
+	slack_expires = rq->ss_slack_expires;
+	slack_prio = rq->ss_slack_prio;
+
+	now = ktime_get();
+	ss_reset_server(ss, now);
+	ss_charge(ss, 10 * NSEC_PER_MSEC);
+
+	rq->ss_slack = 5 * NSEC_PER_MSEC;
+	rq->ss_slack_expires = ktime_add_ns(now, 50 * NSEC_PER_MSEC);
+	rq->ss_slack_prio = ss->prio;
+
+	if (!ss_slack_take(rq, ss, now) || rq->ss_slack ||
+	    ktime_to_ns(ss_capacity(ss, now)) != 5 * NSEC_PER_MSEC) {
+		printk(KERN_ERR "ss_slack_test: slack not drawn\n");
+		err = -EINVAL;
+		goto out;
+	}
+
+	ss_charge(ss, 2 * NSEC_PER_MSEC);
+	if (ktime_to_ns(ss_capacity(ss, now)) != 3 * NSEC_PER_MSEC) {
+		printk(KERN_ERR "ss_slack_test: slack not used first\n");
+		err = -EINVAL;
+		goto out;
+	}
+
+	ss_split_check(ss);
+	if (ss_capacity(ss, now).tv64 || ss->nr_repl != 1 ||
+	    ktime_to_ns(ss_rl_last(ss)->amt) != 10 * NSEC_PER_MSEC) {
+		printk(KERN_ERR "ss_slack_test: capacity %lld, replenishment "
+		       "%lld after blocking\n",
+		       ktime_to_ns(ss_capacity(ss, now)),
+		       ktime_to_ns(ss_rl_last(ss)->amt));
+		err = -EINVAL;
+	}
+
+out:
+	rq->ss_stats = stats;
+	rq->ss_slack = slack;
+	rq->ss_slack_expires = slack_expires;
+	rq->ss_slack_prio = slack_prio;
+	raw_spin_unlock_irq(&rq->lock);
+
+	ss_free_server(ss);
+
+	return err;
+}
+late_initcall(ss_slack_test);
+#endif /* CONFIG_TEST_SCHED_SPORADIC */
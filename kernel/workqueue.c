@@ -41,6 +41,7 @@
 #include <linux/debug_locks.h>
 #include <linux/lockdep.h>
 #include <linux/idr.h>
+#include <linux/sysfs.h>
 
 #include "workqueue_sched.h"
 
@@ -112,6 +113,8 @@ enum {
  * F: wq->flush_mutex protected.
  *
  * W: workqueue_lock protected.
+ *
+ * S: wq_server_mutex protected.
  */
 
 struct global_cwq;
@@ -184,6 +187,8 @@ struct cpu_workqueue_struct {
 	int			nr_active;	/* L: nr of active works */
 	int			max_active;	/* L: max active works */
 	struct list_head	delayed_works;	/* L: delayed works */
+	struct worker		*server;	/* L: server worker, see
+						   cwq_server() */
 };
 
 /*
@@ -242,6 +247,11 @@ struct workqueue_struct {
 
 	int			saved_max_active; /* W: saved cwq max_active */
 	const char		*name;		/* I: workqueue name */
+
+	struct kobject		kobj;		/* S: for WQ_SERVER */
+	struct list_head	server_list;	/* S: list of server wqs */
+	u64			ss_budget;	/* S: server budget in ns */
+	u64			ss_period;	/* S: server period in ns */
 #ifdef CONFIG_LOCKDEP
 	struct lockdep_map	lockdep_map;
 #endif
@@ -868,6 +878,27 @@ static struct worker *find_worker_executing_work(struct global_cwq *gcwq,
 					    work);
 }
 
+/**
+ * cwq_server - the server of a cwq
+ * @cwq: cwq of interest
+ *
+ * The server of a cwq of a bound server wq is created when its cpu
+ * comes online.  Until then, works issued on the cwq are left to the
+ * gcwq workers as for any other workqueue.
+ *
+ * CONTEXT:
+ * spin_lock_irq(gcwq->lock).
+ *
+ * RETURNS:
+ * The server worker, NULL if @cwq has none.
+ */
+static inline struct worker *cwq_server(struct cpu_workqueue_struct *cwq)
+{
+	if (likely(!(cwq->wq->flags & WQ_SERVER)))
+		return NULL;
+	return cwq->server;
+}
+
 /**
  * gcwq_determine_ins_pos - find insertion position
  * @gcwq: gcwq of interest
@@ -889,8 +920,13 @@ static struct worker *find_worker_executing_work(struct global_cwq *gcwq,
 static inline struct list_head *gcwq_determine_ins_pos(struct global_cwq *gcwq,
 					       struct cpu_workqueue_struct *cwq)
 {
+	struct worker *server = cwq_server(cwq);
 	struct work_struct *twork;
 
+	/* works of a server wq bypass the gcwq, see server_thread() */
+	if (server)
+		return &server->scheduled;
+
 	if (likely(!(cwq->wq->flags & WQ_HIGHPRI)))
 		return &gcwq->worklist;
 
@@ -923,6 +959,7 @@ static void insert_work(struct cpu_workqueue_struct *cwq,
 			unsigned int extra_flags)
 {
 	struct global_cwq *gcwq = cwq->gcwq;
+	struct worker *server = cwq_server(cwq);
 
 	/* we own @work, set data and link */
 	set_work_cwq(work, cwq, extra_flags);
@@ -942,7 +979,9 @@ static void insert_work(struct cpu_workqueue_struct *cwq,
 	 */
 	smp_mb();
 
-	if (__need_more_worker(gcwq))
+	if (server)
+		wake_up_process(server->task);
+	else if (__need_more_worker(gcwq))
 		wake_up_worker(gcwq);
 }
 
@@ -1723,11 +1762,15 @@ static void cwq_activate_first_delayed(struct cpu_workqueue_struct *cwq)
 	struct work_struct *work = list_first_entry(&cwq->delayed_works,
 						    struct work_struct, entry);
 	struct list_head *pos = gcwq_determine_ins_pos(cwq->gcwq, cwq);
+	struct worker *server = cwq_server(cwq);
 
 	trace_workqueue_activate_work(work);
 	move_linked_works(work, pos, NULL);
 	__clear_bit(WORK_STRUCT_DELAYED_BIT, work_data_bits(work));
 	cwq->nr_active++;
+
+	if (server)
+		wake_up_process(server->task);
 }
 
 /**
@@ -2081,6 +2124,51 @@ repeat:
 	goto repeat;
 }
 
+/**
+ * server_thread - the server thread function
+ * @__cwq: the associated cwq
+ *
+ * Workqueue server thread function.  Each cwq of a workqueue which has
+ * WQ_SERVER set has its own server, which is the only execution
+ * context of the works issued on the cwq.  Active works are queued
+ * directly on its ->scheduled list instead of on the gcwq worklist, and
+ * the server processes them in order.
+ *
+ * This takes the works out of concurrency management, which shares the
+ * workers of a gcwq among all workqueues: a single task is all that
+ * SCHED_SPORADIC can bound, see workqueue_set_server().  As for
+ * ordered workqueues, a work which sleeps holds up the following ones.
+ */
+static int server_thread(void *__cwq)
+{
+	struct cpu_workqueue_struct *cwq = __cwq;
+	struct worker *server = cwq->server;
+	struct global_cwq *gcwq = cwq->gcwq;
+
+repeat:
+	set_current_state(TASK_INTERRUPTIBLE);
+
+	if (kthread_should_stop())
+		return 0;
+
+	spin_lock_irq(&gcwq->lock);
+	if (list_empty(&server->scheduled)) {
+		spin_unlock_irq(&gcwq->lock);
+		schedule();
+		goto repeat;
+	}
+	spin_unlock_irq(&gcwq->lock);
+
+	__set_current_state(TASK_RUNNING);
+
+	/* we may have been moved away by cpu hotplug */
+	worker_maybe_bind_and_lock(server);
+	process_scheduled_works(server);
+	spin_unlock_irq(&gcwq->lock);
+
+	goto repeat;
+}
+
 struct wq_barrier {
 	struct work_struct	work;
 	struct completion	done;
@@ -2900,6 +2988,312 @@ static int wq_clamp_max_active(int max_active, unsigned int flags,
 	return clamp_val(max_active, 1, lim);
 }
 
+/*
+ * Server workqueues are listed in /sys/kernel/workqueue/<name>/, where
+ * ss_budget and ss_period set their server parameters in us.
+ */
+static DEFINE_MUTEX(wq_server_mutex);
+static LIST_HEAD(wq_servers);		/* S: list of server wqs */
+static struct kobject *wq_server_kobj;	/* S: /sys/kernel/workqueue */
+
+/* run @task as a server of @budget every @period, SCHED_NORMAL if 0 */
+static int wq_server_set(struct task_struct *task, u64 budget, u64 period)
+{
+	struct sched_param param = {
+		.sched_priority = MAX_USER_RT_PRIO/2,
+		.sched_ss_low_priority = 1,
+		.sched_ss_max_repl = SS_REPL_MAX,
+		.sched_ss_mode = SS_MODE_SPORADIC,
+		.sched_ss_bg_policy = SS_BG_SUSPEND,
+	};
+	int policy = SCHED_SPORADIC;
+
+	param.sched_ss_repl_period = ns_to_timespec(period);
+	param.sched_ss_init_budget = ns_to_timespec(budget);
+	if (!budget) {
+		policy = SCHED_NORMAL;
+		memset(&param, 0, sizeof(param));
+	}
+
+	return sched_setscheduler_nocheck(task, policy, &param);
+}
+
+/* called with wq_server_mutex held */
+static int wq_server_set_cwqs(struct workqueue_struct *wq,
+			      u64 budget, u64 period)
+{
+	unsigned int cpu;
+	int err = 0;
+
+	for_each_cwq_cpu(cpu, wq) {
+		struct cpu_workqueue_struct *cwq = get_cwq(cpu, wq);
+
+		/* cpus not up yet pick the parameters up in start_server() */
+		if (!cwq->server)
+			continue;
+
+		err = wq_server_set(cwq->server->task, budget, period);
+		if (err)
+			break;
+	}
+
+	return err;
+}
+
+/**
+ * workqueue_set_server - bound the execution of a server workqueue
+ * @wq: target workqueue, which must have WQ_SERVER set
+ * @budget: budget in ns, 0 to run the works as SCHED_NORMAL
+ * @period: replenishment period in ns
+ *
+ * Run the server of each cwq of @wq as a SCHED_SPORADIC server of
+ * @budget every @period, which then is the bandwidth of all the works
+ * issued on that cpu.  If admission control refuses any of them, the
+ * servers are left with their previous parameters and -EBUSY is
+ * returned.
+ *
+ * CONTEXT:
+ * Might sleep.
+ */
+int workqueue_set_server(struct workqueue_struct *wq, u64 budget, u64 period)
+{
+	int err;
+
+	if (!(wq->flags & WQ_SERVER))
+		return -EINVAL;
+
+	if (budget && (!period || budget > period))
+		return -EINVAL;
+
+	mutex_lock(&wq_server_mutex);
+	err = wq_server_set_cwqs(wq, budget, period);
+	if (err)
+		WARN_ON(wq_server_set_cwqs(wq, wq->ss_budget, wq->ss_period));
+	else {
+		wq->ss_budget = budget;
+		wq->ss_period = period;
+	}
+	mutex_unlock(&wq_server_mutex);
+
+	return err;
+}
+EXPORT_SYMBOL_GPL(workqueue_set_server);
+
+static void wq_server_release(struct kobject *kobj)
+{
+	struct workqueue_struct *wq =
+		container_of(kobj, struct workqueue_struct, kobj);
+
+	free_cwqs(wq);
+	kfree(wq);
+}
+
+static ssize_t wq_server_show(struct kobject *kobj, struct attribute *attr,
+			      char *buf)
+{
+	struct workqueue_struct *wq =
+		container_of(kobj, struct workqueue_struct, kobj);
+	u64 val;
+
+	mutex_lock(&wq_server_mutex);
+	if (!strcmp(attr->name, "ss_budget"))
+		val = wq->ss_budget;
+	else
+		val = wq->ss_period;
+	mutex_unlock(&wq_server_mutex);
+
+	return sprintf(buf, "%llu\n", div_u64(val, NSEC_PER_USEC));
+}
+
+static ssize_t wq_server_store(struct kobject *kobj, struct attribute *attr,
+			       const char *buf, size_t count)
+{
+	struct workqueue_struct *wq =
+		container_of(kobj, struct workqueue_struct, kobj);
+	unsigned long long val;
+	u64 budget, period;
+	int err;
+
+	err = kstrtoull(buf, 0, &val);
+	if (err)
+		return err;
+
+	mutex_lock(&wq_server_mutex);
+	budget = wq->ss_budget;
+	period = wq->ss_period;
+	mutex_unlock(&wq_server_mutex);
+
+	if (!strcmp(attr->name, "ss_budget"))
+		budget = val * NSEC_PER_USEC;
+	else
+		period = val * NSEC_PER_USEC;
+
+	err = workqueue_set_server(wq, budget, period);
+
+	return err ? err : count;
+}
+
+static struct attribute wq_server_budget_attr = {
+	.name = "ss_budget",
+	.mode = S_IRUGO | S_IWUSR,
+};
+
+static struct attribute wq_server_period_attr = {
+	.name = "ss_period",
+	.mode = S_IRUGO | S_IWUSR,
+};
+
+static struct attribute *wq_server_attrs[] = {
+	&wq_server_budget_attr,
+	&wq_server_period_attr,
+	NULL
+};
+
+static const struct sysfs_ops wq_server_sysfs_ops = {
+	.show	= wq_server_show,
+	.store	= wq_server_store,
+};
+
+static struct kobj_type wq_server_ktype = {
+	.release	= wq_server_release,
+	.sysfs_ops	= &wq_server_sysfs_ops,
+	.default_attrs	= wq_server_attrs,
+};
+
+/* called with wq_server_mutex held */
+static void wq_server_add_sysfs(struct workqueue_struct *wq)
+{
+	if (kobject_add(&wq->kobj, wq_server_kobj, "%s", wq->name))
+		printk(KERN_WARNING "workqueue %s: can't add the server "
+		       "to sysfs\n", wq->name);
+}
+
+static int __init wq_server_sysfs_init(void)
+{
+	struct workqueue_struct *wq;
+
+	mutex_lock(&wq_server_mutex);
+	wq_server_kobj = kobject_create_and_add("workqueue", kernel_kobj);
+	if (wq_server_kobj)
+		list_for_each_entry(wq, &wq_servers, server_list)
+			wq_server_add_sysfs(wq);
+	mutex_unlock(&wq_server_mutex);
+
+	return wq_server_kobj ? 0 : -ENOMEM;
+}
+postcore_initcall(wq_server_sysfs_init);
+
+/**
+ * start_server - create and start the server of a cwq
+ * @wq: the server wq
+ * @cpu: cpu of the cwq, which must be online unless @wq is unbound
+ *
+ * The server is bound to @cpu and given the parameters of @wq before it
+ * is installed as the server of the cwq and woken up.  If they don't fit
+ * on @cpu, it runs as SCHED_NORMAL.
+ *
+ * CONTEXT:
+ * wq_server_mutex held, might sleep.
+ *
+ * RETURNS:
+ * 0 on success, -ENOMEM otherwise.
+ */
+static int start_server(struct workqueue_struct *wq, unsigned int cpu)
+{
+	struct cpu_workqueue_struct *cwq = get_cwq(cpu, wq);
+	struct global_cwq *gcwq = cwq->gcwq;
+	struct worker *server;
+
+	server = alloc_worker();
+	if (!server)
+		return -ENOMEM;
+
+	server->gcwq = gcwq;
+	if (wq->flags & WQ_UNBOUND)
+		server->task = kthread_create(server_thread, cwq,
+					      "%s/u", wq->name);
+	else
+		server->task = kthread_create(server_thread, cwq,
+					      "%s/%u", wq->name, cpu);
+	if (IS_ERR(server->task)) {
+		kfree(server);
+		return -ENOMEM;
+	}
+
+	if (wq->flags & WQ_UNBOUND)
+		server->task->flags |= PF_THREAD_BOUND;
+	else
+		kthread_bind(server->task, cpu);
+
+	if (wq->ss_budget &&
+	    wq_server_set(server->task, wq->ss_budget, wq->ss_period))
+		printk(KERN_WARNING "workqueue %s: the server on cpu %u "
+		       "doesn't fit, running it as SCHED_NORMAL\n",
+		       wq->name, cpu);
+
+	spin_lock_irq(&gcwq->lock);
+	cwq->server = server;
+	spin_unlock_irq(&gcwq->lock);
+
+	wake_up_process(server->task);
+	return 0;
+}
+
+/*
+ * Start the servers of @wq on the cpus which are online, the others are
+ * started by wq_server_cpu_online().  The caller holds get_online_cpus().
+ */
+static int alloc_servers(struct workqueue_struct *wq)
+{
+	unsigned int cpu;
+
+	for_each_cwq_cpu(cpu, wq) {
+		if (!(wq->flags & WQ_UNBOUND) && !cpu_online(cpu))
+			continue;
+		if (start_server(wq, cpu) < 0)
+			return -ENOMEM;
+	}
+
+	return 0;
+}
+
+/*
+ * @cpu came online, start the servers it doesn't have yet.  Those of a
+ * cpu that went down were left running like the gcwq workers, they bind
+ * themselves back to it once they have work, see server_thread().
+ */
+static void __cpuinit wq_server_cpu_online(unsigned int cpu)
+{
+	struct workqueue_struct *wq;
+
+	mutex_lock(&wq_server_mutex);
+	list_for_each_entry(wq, &wq_servers, server_list) {
+		if (wq->flags & WQ_UNBOUND || get_cwq(cpu, wq)->server)
+			continue;
+		if (start_server(wq, cpu) < 0)
+			printk(KERN_WARNING "workqueue %s: can't create the "
+			       "server on cpu %u, its works are run by the "
+			       "gcwq\n", wq->name, cpu);
+	}
+	mutex_unlock(&wq_server_mutex);
+}
+
+static void free_servers(struct workqueue_struct *wq)
+{
+	unsigned int cpu;
+
+	for_each_cwq_cpu(cpu, wq) {
+		struct cpu_workqueue_struct *cwq = get_cwq(cpu, wq);
+
+		if (!cwq->server)
+			continue;
+		if (cwq->server->task)
+			kthread_stop(cwq->server->task);
+		kfree(cwq->server);
+		cwq->server = NULL;
+	}
+}
+
 struct workqueue_struct *__alloc_workqueue_key(const char *name,
 					       unsigned int flags,
 					       int max_active,
@@ -2911,9 +3305,10 @@ struct workqueue_struct *__alloc_workqueue_key(const char *name,
 
 	/*
 	 * Workqueues which may be used during memory reclaim should
-	 * have a rescuer to guarantee forward progress.
+	 * have a rescuer to guarantee forward progress.  A server wq
+	 * has its own execution contexts and never needs rescuing.
 	 */
-	if (flags & WQ_MEM_RECLAIM)
+	if (flags & WQ_MEM_RECLAIM && !(flags & WQ_SERVER))
 		flags |= WQ_RESCUER;
 
 	/*
@@ -2940,6 +3335,7 @@ struct workqueue_struct *__alloc_workqueue_key(const char *name,
 	wq->name = name;
 	lockdep_init_map(&wq->lockdep_map, lock_name, key, 0);
 	INIT_LIST_HEAD(&wq->list);
+	INIT_LIST_HEAD(&wq->server_list);
 
 	if (alloc_cwqs(wq) < 0)
 		goto err;
@@ -2974,6 +3370,24 @@ struct workqueue_struct *__alloc_workqueue_key(const char *name,
 		wake_up_process(rescuer->task);
 	}
 
+	if (flags & WQ_SERVER) {
+		/* no cpu may come up between the two */
+		get_online_cpus();
+		mutex_lock(&wq_server_mutex);
+		if (alloc_servers(wq) < 0) {
+			mutex_unlock(&wq_server_mutex);
+			put_online_cpus();
+			goto err;
+		}
+
+		kobject_init(&wq->kobj, &wq_server_ktype);
+		list_add(&wq->server_list, &wq_servers);
+		if (wq_server_kobj)
+			wq_server_add_sysfs(wq);
+		mutex_unlock(&wq_server_mutex);
+		put_online_cpus();
+	}
+
 	/*
 	 * workqueue_lock protects global freeze state and workqueues
 	 * list.  Grab it, set max_active accordingly and add the new
@@ -2992,6 +3406,8 @@ struct workqueue_struct *__alloc_workqueue_key(const char *name,
 	return wq;
 err:
 	if (wq) {
+		if (wq->cpu_wq.v && flags & WQ_SERVER)
+			free_servers(wq);
 		free_cwqs(wq);
 		free_mayday_mask(wq->mayday_mask);
 		kfree(wq->rescuer);
@@ -3063,6 +3479,24 @@ reflush:
 		kfree(wq->rescuer);
 	}
 
+	if (wq->flags & WQ_SERVER) {
+		/*
+		 * Take @wq out of sight of cpu hotplug and sysfs before the
+		 * servers go.  kobject_del() waits for the sysfs writes in
+		 * progress, which take wq_server_mutex.
+		 */
+		mutex_lock(&wq_server_mutex);
+		list_del(&wq->server_list);
+		mutex_unlock(&wq_server_mutex);
+		kobject_del(&wq->kobj);
+
+		free_servers(wq);
+
+		/* the last reference to the kobject frees @wq */
+		kobject_put(&wq->kobj);
+		return;
+	}
+
 	free_cwqs(wq);
 	kfree(wq);
 }
@@ -3546,6 +3980,9 @@ static int __devinit workqueue_cpu_callback(struct notifier_block *nfb,
 
 	spin_unlock_irqrestore(&gcwq->lock, flags);
 
+	if (action == CPU_ONLINE)
+		wq_server_cpu_online(cpu);
+
 	return notifier_from_errno(0);
 }
 
@@ -82,6 +82,7 @@
 #include <linux/hash.h>
 #include <linux/slab.h>
 #include <linux/sched.h>
+#include <linux/kthread.h>
 #include <linux/mutex.h>
 #include <linux/string.h>
 #include <linux/mm.h>
@@ -2499,10 +2500,36 @@ int netdev_tstamp_prequeue __read_mostly = 1;
 int netdev_budget __read_mostly = 300;
 int weight_p __read_mostly = 64;            /* old backlog weight */
 
+/*
+ * Queue napi to the polling thread of its device, if it has one.
+ * Called with irq disabled.
+ */
+static bool napi_thread_queue(struct napi_struct *napi)
+{
+	struct net_device *dev = napi->dev;
+	bool queued = false;
+
+	if (likely(!dev || !dev->napi_thread))
+		return false;
+
+	spin_lock(&dev->napi_lock);
+	if (dev->napi_thread) {
+		list_add_tail(&napi->poll_list, &dev->napi_poll_list);
+		wake_up_process(dev->napi_thread);
+		queued = true;
+	}
+	spin_unlock(&dev->napi_lock);
+
+	return queued;
+}
+
 /* Called with irq disabled */
 static inline void ____napi_schedule(struct softnet_data *sd,
 				     struct napi_struct *napi)
 {
+	if (napi_thread_queue(napi))
+		return;
+
 	list_add_tail(&napi->poll_list, &sd->poll_list);
 	__raise_softirq_irqoff(NET_RX_SOFTIRQ);
 }
@@ -3761,6 +3788,179 @@ void netif_napi_del(struct napi_struct *napi)
 }
 EXPORT_SYMBOL(netif_napi_del);
 
+/*
+ * NAPI polling threads
+ *
+ * A device can have its NAPI instances polled by a kthread of its own,
+ * run as a SCHED_SPORADIC polling server, instead of by the NET_RX
+ * softirq.  Receive processing then gets its budget every period, at a
+ * high rt priority, and cannot take more than that from the tasks below.
+ *
+ * The thread takes an instance off the device list before polling it,
+ * so the list only ever changes under dev->napi_lock and a driver
+ * completing the instance deletes it from no list.
+ */
+static void napi_thread_poll(struct net_device *dev, struct napi_struct *n)
+{
+	int work, weight = n->weight;
+	void *have;
+
+	have = netpoll_poll_lock(n);
+	local_bh_disable();
+
+	work = 0;
+	if (test_bit(NAPI_STATE_SCHED, &n->state)) {
+		work = n->poll(n, weight);
+		trace_napi_poll(n);
+	}
+
+	WARN_ON_ONCE(work > weight);
+
+	/* as in net_rx_action(), we still own an instance that used it all */
+	if (unlikely(work == weight)) {
+		if (unlikely(napi_disable_pending(n))) {
+			napi_complete(n);
+		} else {
+			spin_lock_irq(&dev->napi_lock);
+			list_add_tail(&n->poll_list, &dev->napi_poll_list);
+			spin_unlock_irq(&dev->napi_lock);
+		}
+	}
+
+	local_bh_enable();
+	netpoll_poll_unlock(have);
+}
+
+static int napi_thread(void *data)
+{
+	struct net_device *dev = data;
+
+	for (;;) {
+		struct napi_struct *n = NULL;
+
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (kthread_should_stop())
+			break;
+
+		spin_lock_irq(&dev->napi_lock);
+		if (!list_empty(&dev->napi_poll_list)) {
+			n = list_first_entry(&dev->napi_poll_list,
+					     struct napi_struct, poll_list);
+			list_del_init(&n->poll_list);
+		}
+		spin_unlock_irq(&dev->napi_lock);
+
+		if (!n) {
+			schedule();
+			continue;
+		}
+
+		__set_current_state(TASK_RUNNING);
+		napi_thread_poll(dev, n);
+		cond_resched();
+	}
+	__set_current_state(TASK_RUNNING);
+
+	return 0;
+}
+
+/* Hand the instances the thread of dev left behind to the softirq. */
+static void napi_thread_stop(struct net_device *dev)
+{
+	struct task_struct *t;
+
+	spin_lock_irq(&dev->napi_lock);
+	t = dev->napi_thread;
+	dev->napi_thread = NULL;
+	spin_unlock_irq(&dev->napi_lock);
+
+	if (!t)
+		return;
+
+	kthread_stop(t);
+	put_task_struct(t);
+
+	spin_lock_irq(&dev->napi_lock);
+	while (!list_empty(&dev->napi_poll_list)) {
+		struct napi_struct *n;
+
+		n = list_first_entry(&dev->napi_poll_list,
+				     struct napi_struct, poll_list);
+		list_del_init(&n->poll_list);
+		____napi_schedule(&__get_cpu_var(softnet_data), n);
+	}
+	spin_unlock_irq(&dev->napi_lock);
+}
+
+/**
+ *	dev_set_napi_server - poll NAPI of a device under a polling server
+ *	@dev: device
+ *	@budget: budget in ns, 0 to poll from the NET_RX softirq again
+ *	@period: replenishment period in ns
+ *
+ *	Starts a kthread that polls the NAPI instances of @dev as a
+ *	SCHED_SPORADIC polling server of @budget every @period, or retunes
+ *	the one there is.  Fails with -EBUSY if admission control has no
+ *	room for the server, in which case @dev is left as it was.  Must be
+ *	called with rtnl held.
+ */
+int dev_set_napi_server(struct net_device *dev, u64 budget, u64 period)
+{
+	struct sched_param param = {
+		.sched_priority = MAX_USER_RT_PRIO/2,
+		.sched_ss_low_priority = 1,
+		.sched_ss_max_repl = 1,
+		.sched_ss_mode = SS_MODE_POLLING,
+		.sched_ss_bg_policy = SS_BG_SUSPEND,
+	};
+	struct task_struct *t;
+	int err;
+
+	ASSERT_RTNL();
+
+	if (budget && (!period || budget > period))
+		return -EINVAL;
+
+	if (!budget) {
+		napi_thread_stop(dev);
+		goto out;
+	}
+
+	param.sched_ss_repl_period = ns_to_timespec(period);
+	param.sched_ss_init_budget = ns_to_timespec(budget);
+
+	/* the running server is retuned in place, unchanged on failure */
+	if (dev->napi_thread) {
+		err = sched_setscheduler_nocheck(dev->napi_thread,
+						 SCHED_SPORADIC, &param);
+		if (err)
+			return err;
+		goto out;
+	}
+
+	t = kthread_create(napi_thread, dev, "napi/%s", dev->name);
+	if (IS_ERR(t))
+		return PTR_ERR(t);
+
+	err = sched_setscheduler_nocheck(t, SCHED_SPORADIC, &param);
+	if (err) {
+		kthread_stop(t);
+		return err;
+	}
+
+	get_task_struct(t);
+	spin_lock_irq(&dev->napi_lock);
+	dev->napi_thread = t;
+	spin_unlock_irq(&dev->napi_lock);
+	wake_up_process(t);
+out:
+	dev->napi_ss_budget = budget;
+	dev->napi_ss_period = period;
+
+	return 0;
+}
+EXPORT_SYMBOL(dev_set_napi_server);
+
 static void net_rx_action(struct softirq_action *h)
 {
 	struct softnet_data *sd = &__get_cpu_var(softnet_data);
@@ -5154,6 +5354,9 @@ static void rollback_registered_many(struct list_head *head)
 		/* Shutdown queueing discipline. */
 		dev_shutdown(dev);
 
+		/* Poll from the softirq again, the thread refers to dev. */
+		dev_set_napi_server(dev, 0, 0);
+
 
 		/* Notify protocols, that we are about to destroy
 		   this device. They should clean all the things.
@@ -5558,6 +5761,8 @@ int init_dummy_netdev(struct net_device *dev)
 
 	/* NAPI wants this */
 	INIT_LIST_HEAD(&dev->napi_list);
+	spin_lock_init(&dev->napi_lock);
+	INIT_LIST_HEAD(&dev->napi_poll_list);
 
 	/* a dummy interface is started by default */
 	set_bit(__LINK_STATE_PRESENT, &dev->state);
@@ -5870,6 +6075,8 @@ struct net_device *alloc_netdev_mqs(int sizeof_priv, const char *name,
 	INIT_LIST_HEAD(&dev->ethtool_ntuple_list.list);
 	dev->ethtool_ntuple_list.count = 0;
 	INIT_LIST_HEAD(&dev->napi_list);
+	spin_lock_init(&dev->napi_lock);
+	INIT_LIST_HEAD(&dev->napi_poll_list);
 	INIT_LIST_HEAD(&dev->unreg_list);
 	INIT_LIST_HEAD(&dev->link_watch_list);
 	dev->priv_flags = IFF_XMIT_DST_RELEASE;
@@ -291,6 +291,61 @@ static ssize_t show_ifalias(struct device *dev,
 	return ret;
 }
 
+/* budget and period of the NAPI polling server, in us, see dev_set_napi_server() */
+static ssize_t format_napi_ss_budget(const struct net_device *net, char *buf)
+{
+	return sprintf(buf, fmt_u64, div_u64(net->napi_ss_budget, NSEC_PER_USEC));
+}
+
+static ssize_t show_napi_ss_budget(struct device *dev,
+				   struct device_attribute *attr, char *buf)
+{
+	return netdev_show(dev, attr, buf, format_napi_ss_budget);
+}
+
+static int change_napi_ss_budget(struct net_device *net, unsigned long budget)
+{
+	return dev_set_napi_server(net, (u64)budget * NSEC_PER_USEC,
+				   net->napi_ss_period);
+}
+
+static ssize_t store_napi_ss_budget(struct device *dev,
+				    struct device_attribute *attr,
+				    const char *buf, size_t len)
+{
+	return netdev_store(dev, attr, buf, len, change_napi_ss_budget);
+}
+
+static ssize_t format_napi_ss_period(const struct net_device *net, char *buf)
+{
+	return sprintf(buf, fmt_u64, div_u64(net->napi_ss_period, NSEC_PER_USEC));
+}
+
+static ssize_t show_napi_ss_period(struct device *dev,
+				   struct device_attribute *attr, char *buf)
+{
+	return netdev_show(dev, attr, buf, format_napi_ss_period);
+}
+
+/* with a polling thread running, a new period restarts it */
+static int change_napi_ss_period(struct net_device *net, unsigned long period)
+{
+	if (!net->napi_ss_budget) {
+		net->napi_ss_period = (u64)period * NSEC_PER_USEC;
+		return 0;
+	}
+
+	return dev_set_napi_server(net, net->napi_ss_budget,
+				   (u64)period * NSEC_PER_USEC);
+}
+
+static ssize_t store_napi_ss_period(struct device *dev,
+				    struct device_attribute *attr,
+				    const char *buf, size_t len)
+{
+	return netdev_store(dev, attr, buf, len, change_napi_ss_period);
+}
+
 NETDEVICE_SHOW(group, fmt_dec);
 
 static int change_group(struct net_device *net, unsigned long new_group)
@@ -327,6 +382,10 @@ static struct device_attribute net_class_attributes[] = {
 	__ATTR(tx_queue_len, S_IRUGO | S_IWUSR, show_tx_queue_len,
 	       store_tx_queue_len),
 	__ATTR(netdev_group, S_IRUGO | S_IWUSR, show_group, store_group),
+	__ATTR(napi_ss_budget, S_IRUGO | S_IWUSR, show_napi_ss_budget,
+	       store_napi_ss_budget),
+	__ATTR(napi_ss_period, S_IRUGO | S_IWUSR, show_napi_ss_period,
+	       store_napi_ss_period),
 	{}
 };
 
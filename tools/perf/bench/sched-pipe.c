@@ -27,13 +27,42 @@
 #include <assert.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <sys/syscall.h>
+
+/* from include/linux/sched.h, the C library doesn't know them */
+#ifndef SCHED_SPORADIC
+#define SCHED_SPORADIC		6
+#endif
+
+#define SS_BG_RT		1
+
+struct sched_ss_param {
+	int sched_priority;
+	int sched_ss_low_priority;
+	struct timespec sched_ss_repl_period;
+	struct timespec sched_ss_init_budget;
+	int sched_ss_max_repl;
+	int sched_ss_mode;
+	int sched_ss_bg_policy;
+	struct timespec sched_ss_min_budget;
+	struct timespec sched_ss_max_budget;
+};
 
 #define LOOPS_DEFAULT 1000000
 static int loops = LOOPS_DEFAULT;
+static bool sporadic;
+static u64 budget_us = 40000;
+static u64 period_us = 100000;
 
 static const struct option options[] = {
 	OPT_INTEGER('l', "loop", &loops,
 		    "Specify number of loops"),
+	OPT_BOOLEAN('s', "sporadic", &sporadic,
+		    "Run both tasks as SCHED_SPORADIC servers"),
+	OPT_U64('b', "budget", &budget_us,
+		"Server budget in usecs (with -s)"),
+	OPT_U64('P', "period", &period_us,
+		"Server replenishment period in usecs (with -s)"),
 	OPT_END()
 };
 
@@ -42,6 +71,39 @@ static const char * const bench_sched_pipe_usage[] = {
 	NULL
 };
 
+static struct timespec us_to_ts(u64 us)
+{
+	struct timespec ts;
+
+	ts.tv_sec = us / 1000000;
+	ts.tv_nsec = (us % 1000000) * 1000;
+	return ts;
+}
+
+/*
+ * Make the caller a SCHED_SPORADIC server at priority 50, that goes on at
+ * priority 1 once its budget is used up.  The task forked next gets a
+ * server of its own with the same parameters.
+ */
+static void set_sporadic(void)
+{
+	struct sched_ss_param param;
+
+	memset(&param, 0, sizeof(param));
+	param.sched_priority = 50;
+	param.sched_ss_low_priority = 1;
+	param.sched_ss_repl_period = us_to_ts(period_us);
+	param.sched_ss_init_budget = us_to_ts(budget_us);
+	param.sched_ss_max_repl = 10;
+	param.sched_ss_bg_policy = SS_BG_RT;
+
+	if (syscall(__NR_sched_setscheduler, 0, SCHED_SPORADIC, &param)) {
+		fprintf(stderr, "sched_setscheduler: %s%s\n", strerror(errno),
+			errno == EBUSY ? " (no bandwidth left)" : "");
+		exit(1);
+	}
+}
+
 int bench_sched_pipe(int argc, const char **argv,
 		     const char *prefix __used)
 {
@@ -64,6 +126,9 @@ int bench_sched_pipe(int argc, const char **argv,
 	assert(!pipe(pipe_1));
 	assert(!pipe(pipe_2));
 
+	if (sporadic)
+		set_sporadic();
+
 	pid = fork();
 	assert(pid >= 0);
 
@@ -0,0 +1,464 @@
+/*
+ *
+ * sched-server.c
+ *
+ * server: Benchmark for SCHED_SPORADIC servers
+ *
+ * Runs periodic or Poisson arrival jobs of a given cost in threads
+ * scheduled as SCHED_SPORADIC servers (or plain SCHED_FIFO/SCHED_RR for
+ * reference) and measures the response time of each job, deadline
+ * misses and budget overruns.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+
+/* from include/linux/sched.h, the C library doesn't know them */
+#ifndef SCHED_SPORADIC
+#define SCHED_SPORADIC		6
+#endif
+
+#define SS_MODE_SPORADIC	0
+#define SS_MODE_POLLING		1
+#define SS_MODE_DEFERRABLE	2
+
+#define SS_BG_SUSPEND		0
+#define SS_BG_RT		1
+#define SS_BG_FAIR		2
+
+struct sched_ss_param {
+	int sched_priority;
+	int sched_ss_low_priority;
+	struct timespec sched_ss_repl_period;
+	struct timespec sched_ss_init_budget;
+	int sched_ss_max_repl;
+	int sched_ss_mode;
+	int sched_ss_bg_policy;
+	struct timespec sched_ss_min_budget;
+	struct timespec sched_ss_max_budget;
+};
+
+#define NSEC_PER_USEC		((u64)1000)
+
+/* bucket 0 counts responses below 1us, bucket i the ones below 2^i us */
+#define HIST_BUCKETS		24
+
+static const char *policy_str = "sporadic";
+static const char *mode_str = "sporadic";
+static const char *bg_str = "suspend";
+static const char *load_str = "periodic";
+static unsigned int nr_tasks = 1;
+static unsigned int nr_jobs = 1000;
+static unsigned int prio = 50;
+static unsigned int low_prio = 1;
+static unsigned int max_repl = 10;
+static u64 budget_us = 2000;
+static u64 min_budget_us;
+static u64 max_budget_us;
+static u64 period_us = 10000;
+static u64 interval_us = 10000;
+static u64 cost_us = 1000;
+static u64 deadline_us;
+static unsigned int seed = 1;
+
+static const struct option options[] = {
+	OPT_STRING('p', "policy", &policy_str, "policy",
+		    "Scheduling policy: sporadic, fifo or rr"),
+	OPT_STRING('m', "mode", &mode_str, "mode",
+		    "Server mode: sporadic, polling or deferrable"),
+	OPT_STRING('g', "bg", &bg_str, "policy",
+		    "Policy when exhausted: suspend, rt or fair"),
+	OPT_UINTEGER('r', "prio", &prio,
+		    "Priority of the tasks"),
+	OPT_UINTEGER('L', "low-prio", &low_prio,
+		    "Background priority of the servers"),
+	OPT_UINTEGER('R', "max-repl", &max_repl,
+		    "Max pending replenishments of the servers"),
+	OPT_U64('b', "budget", &budget_us,
+		    "Budget of the servers in us"),
+	OPT_U64(0, "min-budget", &min_budget_us,
+		    "Lower bound of adapted budgets in us"),
+	OPT_U64(0, "max-budget", &max_budget_us,
+		    "Upper bound of adapted budgets in us (default: not adapted)"),
+	OPT_U64('P', "period", &period_us,
+		    "Replenishment period of the servers in us"),
+	OPT_STRING('a', "arrival", &load_str, "load",
+		    "Job arrivals: periodic or poisson"),
+	OPT_U64('i', "interval", &interval_us,
+		    "Period, or mean interarrival time, of the jobs in us"),
+	OPT_U64('c', "cost", &cost_us,
+		    "CPU time taken by each job in us"),
+	OPT_U64('d', "deadline", &deadline_us,
+		    "Relative deadline of the jobs in us (default: interval)"),
+	OPT_UINTEGER('t', "tasks", &nr_tasks,
+		    "Number of tasks"),
+	OPT_UINTEGER('n', "jobs", &nr_jobs,
+		    "Number of jobs of each task"),
+	OPT_UINTEGER('s', "seed", &seed,
+		    "Seed of the Poisson arrivals"),
+	OPT_END()
+};
+
+static const char * const bench_sched_server_usage[] = {
+	"perf bench sched server <options>",
+	NULL
+};
+
+struct server_task {
+	pthread_t		thread;
+	unsigned int		id;
+	int			err;
+	u64			*resp;		/* response time of each job */
+	unsigned int		nr_miss;	/* jobs past their deadline */
+	unsigned int		nr_queued;	/* jobs released while busy */
+	/* from /proc/self/task/<tid>/sched, with CONFIG_SCHED_DEBUG */
+	unsigned long		nr_exhaust;
+	unsigned long		nr_overrun;
+	double			overrun_max;	/* in ms */
+	unsigned long		budget_used;	/* permille */
+};
+
+static int policy, ss_mode, ss_bg;
+static bool poisson;
+static pthread_barrier_t start_barrier;
+
+static int parse_name(const char *str, const char * const *names)
+{
+	int i;
+
+	for (i = 0; names[i]; i++)
+		if (!strcmp(str, names[i]))
+			return i;
+	return -1;
+}
+
+static u64 get_nsecs(clockid_t clk)
+{
+	struct timespec ts;
+
+	clock_gettime(clk, &ts);
+	return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static struct timespec ns_to_ts(u64 ns)
+{
+	struct timespec ts;
+
+	ts.tv_sec = ns / NSEC_PER_SEC;
+	ts.tv_nsec = ns % NSEC_PER_SEC;
+	return ts;
+}
+
+static int set_policy(void)
+{
+	struct sched_ss_param param;
+	pid_t tid = syscall(__NR_gettid);
+
+	memset(&param, 0, sizeof(param));
+	param.sched_priority = prio;
+	if (policy == SCHED_SPORADIC) {
+		param.sched_ss_low_priority = low_prio;
+		param.sched_ss_repl_period = ns_to_ts(period_us * NSEC_PER_USEC);
+		param.sched_ss_init_budget = ns_to_ts(budget_us * NSEC_PER_USEC);
+		param.sched_ss_max_repl = max_repl;
+		param.sched_ss_mode = ss_mode;
+		param.sched_ss_bg_policy = ss_bg;
+		param.sched_ss_min_budget = ns_to_ts(min_budget_us * NSEC_PER_USEC);
+		param.sched_ss_max_budget = ns_to_ts(max_budget_us * NSEC_PER_USEC);
+	}
+
+	if (syscall(__NR_sched_setscheduler, tid, policy, &param))
+		return -errno;
+	return 0;
+}
+
+/* burn @ns of CPU time of this thread */
+static void run_job(u64 ns)
+{
+	u64 end = get_nsecs(CLOCK_THREAD_CPUTIME_ID) + ns;
+
+	while (get_nsecs(CLOCK_THREAD_CPUTIME_ID) < end)
+		;
+}
+
+static void read_ss_stats(struct server_task *t)
+{
+	char path[64], line[128], name[64];
+	double val;
+	FILE *fp;
+
+	snprintf(path, sizeof(path), "/proc/self/task/%d/sched",
+		 (int)syscall(__NR_gettid));
+	fp = fopen(path, "r");
+	if (!fp)
+		return;
+
+	while (fgets(line, sizeof(line), fp)) {
+		if (sscanf(line, "%63s : %lf", name, &val) != 2)
+			continue;
+		if (!strcmp(name, "ss.nr_exhaust"))
+			t->nr_exhaust = val;
+		else if (!strcmp(name, "ss.nr_overrun"))
+			t->nr_overrun = val;
+		else if (!strcmp(name, "ss.overrun_max"))
+			t->overrun_max = val;
+		else if (!strcmp(name, "ss.budget_used"))
+			t->budget_used = val;
+	}
+	fclose(fp);
+}
+
+/*
+ * Job k is released at its arrival time and queued behind the previous
+ * ones: it starts once they are done, its response time is measured
+ * from the release.
+ */
+static void *server_task_fn(void *arg)
+{
+	struct server_task *t = arg;
+	u64 deadline = (deadline_us ?: interval_us) * NSEC_PER_USEC;
+	u64 interval = interval_us * NSEC_PER_USEC;
+	u64 cost = cost_us * NSEC_PER_USEC;
+	unsigned short xsubi[3] = { seed, seed >> 16, t->id };
+	u64 release, now;
+	unsigned int k;
+
+	t->err = set_policy();
+	pthread_barrier_wait(&start_barrier);
+	if (t->err)
+		return NULL;
+
+	release = get_nsecs(CLOCK_MONOTONIC) + interval;
+	for (k = 0; k < nr_jobs; k++) {
+		now = get_nsecs(CLOCK_MONOTONIC);
+		if (now < release) {
+			struct timespec ts = ns_to_ts(release);
+
+			while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+					       &ts, NULL) == EINTR)
+				;
+		} else if (k) {
+			t->nr_queued++;
+		}
+
+		run_job(cost);
+
+		now = get_nsecs(CLOCK_MONOTONIC);
+		t->resp[k] = now - release;
+		if (t->resp[k] > deadline)
+			t->nr_miss++;
+
+		if (poisson)
+			release += -log(1.0 - erand48(xsubi)) * interval;
+		else
+			release += interval;
+	}
+
+	read_ss_stats(t);
+
+	return NULL;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	u64 x = *(const u64 *)a, y = *(const u64 *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static u64 percentile(u64 *sorted, unsigned long nr, unsigned int permille)
+{
+	unsigned long i = (nr * permille + 999) / 1000;
+
+	return sorted[i ? i - 1 : 0];
+}
+
+static void print_results(struct server_task *tasks)
+{
+	static const unsigned int pct[] = { 500, 900, 990, 999 };
+	unsigned long hist[HIST_BUCKETS] = { 0, };
+	unsigned long nr = (unsigned long)nr_tasks * nr_jobs;
+	unsigned long nr_miss = 0, nr_queued = 0;
+	unsigned long nr_exhaust = 0, nr_overrun = 0, budget_used = 0;
+	double overrun_max = 0;
+	u64 *all, sum = 0;
+	unsigned long i;
+	unsigned int j;
+
+	all = malloc(nr * sizeof(*all));
+	if (!all)
+		die("memory allocation failed\n");
+
+	for (j = 0; j < nr_tasks; j++) {
+		struct server_task *t = &tasks[j];
+
+		memcpy(all + (unsigned long)j * nr_jobs, t->resp,
+		       nr_jobs * sizeof(*all));
+		nr_miss += t->nr_miss;
+		nr_queued += t->nr_queued;
+		nr_exhaust += t->nr_exhaust;
+		nr_overrun += t->nr_overrun;
+		budget_used += t->budget_used;
+		if (t->overrun_max > overrun_max)
+			overrun_max = t->overrun_max;
+	}
+	budget_used /= nr_tasks;
+
+	qsort(all, nr, sizeof(*all), cmp_u64);
+	for (i = 0; i < nr; i++) {
+		u64 us = all[i] / NSEC_PER_USEC;
+		unsigned int b = 0;
+
+		while (us && b < HIST_BUCKETS - 1) {
+			us >>= 1;
+			b++;
+		}
+		hist[b]++;
+		sum += all[i];
+	}
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %u %s task(s) of %u %s jobs, %" PRIu64 "us every %"
+		       PRIu64 "us\n", nr_tasks, policy_str, nr_jobs, load_str,
+		       cost_us, interval_us);
+		if (policy == SCHED_SPORADIC)
+			printf("# %s servers of %" PRIu64 "us every %" PRIu64
+			       "us\n", mode_str, budget_us, period_us);
+		printf("\n");
+
+		printf(" %14s: %" PRIu64 " [usec]\n", "Response min",
+		       all[0] / NSEC_PER_USEC);
+		printf(" %14s: %" PRIu64 " [usec]\n", "avg",
+		       sum / nr / NSEC_PER_USEC);
+		for (j = 0; j < ARRAY_SIZE(pct); j++)
+			printf(" %9s%2u.%u: %" PRIu64 " [usec]\n", "p",
+			       pct[j] / 10, pct[j] % 10,
+			       percentile(all, nr, pct[j]) / NSEC_PER_USEC);
+		printf(" %14s: %" PRIu64 " [usec]\n\n", "max",
+		       all[nr - 1] / NSEC_PER_USEC);
+
+		printf(" %14s: %lu/%lu\n", "Deadline miss", nr_miss, nr);
+		printf(" %14s: %lu/%lu\n", "Queued", nr_queued, nr);
+		if (policy == SCHED_SPORADIC) {
+			printf(" %14s: %lu\n", "Exhaustions", nr_exhaust);
+			printf(" %14s: %lu (max %.6f ms)\n", "Overruns",
+			       nr_overrun, overrun_max);
+			printf(" %14s: %lu.%lu%%\n", "Budget used",
+			       budget_used / 10, budget_used % 10);
+		}
+
+		printf("\n # Response time histogram\n");
+		for (j = 0; j < HIST_BUCKETS; j++) {
+			if (!hist[j])
+				continue;
+			printf(" %12s %8u [usec]: %lu\n", "<", 1U << j,
+			       hist[j]);
+		}
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("jobs %lu\n", nr);
+		printf("resp_min_ns %" PRIu64 "\n", all[0]);
+		printf("resp_avg_ns %" PRIu64 "\n", sum / nr);
+		for (j = 0; j < ARRAY_SIZE(pct); j++)
+			printf("resp_p%u_ns %" PRIu64 "\n", pct[j],
+			       percentile(all, nr, pct[j]));
+		printf("resp_max_ns %" PRIu64 "\n", all[nr - 1]);
+		printf("deadline_miss %lu\n", nr_miss);
+		printf("queued %lu\n", nr_queued);
+		printf("ss_exhaust %lu\n", nr_exhaust);
+		printf("ss_overrun %lu\n", nr_overrun);
+		printf("ss_overrun_max_ms %.6f\n", overrun_max);
+		printf("ss_budget_used_permille %lu\n", budget_used);
+		for (j = 0; j < HIST_BUCKETS; j++)
+			printf("hist_lt_%uus %lu\n", 1U << j, hist[j]);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	free(all);
+}
+
+int bench_sched_server(int argc, const char **argv,
+		       const char *prefix __used)
+{
+	static const char * const policies[] = { "sporadic", "fifo", "rr", NULL };
+	static const int policy_ids[] = { SCHED_SPORADIC, SCHED_FIFO, SCHED_RR };
+	static const char * const modes[] = { "sporadic", "polling",
+					      "deferrable", NULL };
+	static const char * const bgs[] = { "suspend", "rt", "fair", NULL };
+	static const char * const loads[] = { "periodic", "poisson", NULL };
+	struct server_task *tasks;
+	unsigned int i;
+	int p, err = 0;
+
+	argc = parse_options(argc, argv, options,
+			     bench_sched_server_usage, 0);
+
+	p = parse_name(policy_str, policies);
+	ss_mode = parse_name(mode_str, modes);
+	ss_bg = parse_name(bg_str, bgs);
+	if (p < 0 || ss_mode < 0 || ss_bg < 0 ||
+	    parse_name(load_str, loads) < 0 ||
+	    !nr_tasks || !nr_jobs || !interval_us)
+		usage_with_options(bench_sched_server_usage, options);
+	policy = policy_ids[p];
+	poisson = !strcmp(load_str, "poisson");
+
+	tasks = zalloc(nr_tasks * sizeof(*tasks));
+	if (!tasks)
+		die("memory allocation failed\n");
+
+	pthread_barrier_init(&start_barrier, NULL, nr_tasks);
+	for (i = 0; i < nr_tasks; i++) {
+		tasks[i].id = i;
+		tasks[i].resp = zalloc(nr_jobs * sizeof(u64));
+		if (!tasks[i].resp)
+			die("memory allocation failed\n");
+		if (pthread_create(&tasks[i].thread, NULL, server_task_fn,
+				   &tasks[i]))
+			die("pthread_create failed\n");
+	}
+
+	for (i = 0; i < nr_tasks; i++) {
+		pthread_join(tasks[i].thread, NULL);
+		if (tasks[i].err && !err)
+			err = tasks[i].err;
+	}
+	pthread_barrier_destroy(&start_barrier);
+
+	if (err) {
+		fprintf(stderr, "sched_setscheduler: %s%s\n", strerror(-err),
+			err == -EBUSY ? " (no bandwidth left)" : "");
+		return 1;
+	}
+
+	print_results(tasks);
+
+	for (i = 0; i < nr_tasks; i++)
+		free(tasks[i].resp);
+	free(tasks);
+
+	return 0;
+}
@@ -42,6 +42,9 @@ static struct bench_suite sched_suites[] = {
 	{ "pipe",
 	  "Flood of communication over pipe() between two processes",
 	  bench_sched_pipe      },
+	{ "server",
+	  "Periodic and Poisson jobs under SCHED_SPORADIC servers",
+	  bench_sched_server    },
 	suite_all,
 	{ NULL,
 	  NULL,
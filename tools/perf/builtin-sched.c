@@ -12,6 +12,7 @@
 #include "util/trace-event.h"
 
 #include "util/debug.h"
+#include "util/ss-sim.h"
 
 #include <sys/prctl.h>
 
@@ -721,6 +722,31 @@ struct trace_migrate_task_event {
 	u32 cpu;
 };
 
+/*
+ * Union of the fields of the sched_ss_* events, the ones an event
+ * doesn't have read as 0.
+ */
+struct trace_ss_event {
+	u32 size;
+
+	u16 common_type;
+	u8 common_flags;
+	u8 common_preempt_count;
+	u32 common_pid;
+	u32 common_tgid;
+
+	char comm[16];
+	u32 pid;
+
+	u32 oldprio;
+	u32 newprio;
+	u64 budget;
+	u64 usage;
+	u64 expires;
+	u64 overrun;
+	u32 periods;
+};
+
 struct trace_sched_handler {
 	void (*switch_event)(struct trace_switch_event *,
 			     struct perf_session *,
@@ -755,6 +781,13 @@ struct trace_sched_handler {
 			   int cpu,
 			   u64 timestamp,
 			   struct thread *thread);
+
+	void (*ss_event)(struct trace_ss_event *,
+			 struct perf_session *,
+			 struct event *,
+			 int cpu,
+			 u64 timestamp,
+			 struct thread *thread);
 };
 
 
@@ -1574,6 +1607,35 @@ process_sched_migrate_task_event(void *data, struct perf_session *session,
 						 event, cpu, timestamp, thread);
 }
 
+static void
+process_sched_ss_event(void *data, struct perf_session *session,
+		       struct event *event,
+		       int cpu __used,
+		       u64 timestamp __used,
+		       struct thread *thread __used)
+{
+	struct trace_ss_event ss_event;
+
+	memset(&ss_event, 0, sizeof(ss_event));
+
+	FILL_COMMON_FIELDS(ss_event, event, data);
+
+	if (raw_field_ptr(event, "comm", data))
+		FILL_ARRAY(ss_event, comm, event, data);
+	FILL_FIELD(ss_event, pid, event, data);
+	FILL_FIELD(ss_event, oldprio, event, data);
+	FILL_FIELD(ss_event, newprio, event, data);
+	FILL_FIELD(ss_event, budget, event, data);
+	FILL_FIELD(ss_event, usage, event, data);
+	FILL_FIELD(ss_event, expires, event, data);
+	FILL_FIELD(ss_event, overrun, event, data);
+	FILL_FIELD(ss_event, periods, event, data);
+
+	if (trace_handler->ss_event)
+		trace_handler->ss_event(&ss_event, session, event,
+					cpu, timestamp, thread);
+}
+
 static void process_raw_event(union perf_event *raw_event __used,
 			      struct perf_session *session, void *data, int cpu,
 			      u64 timestamp, struct thread *thread)
@@ -1599,6 +1661,8 @@ static void process_raw_event(union perf_event *raw_event __used,
 		process_sched_exit_event(event, cpu, timestamp, thread);
 	if (!strcmp(event->name, "sched_migrate_task"))
 		process_sched_migrate_task_event(data, session, event, cpu, timestamp, thread);
+	if (!strncmp(event->name, "sched_ss_", 9))
+		process_sched_ss_event(data, session, event, cpu, timestamp, thread);
 }
 
 static int process_sample_event(union perf_event *event,
@@ -1735,6 +1799,850 @@ static void __cmd_map(void)
 	print_bad_events();
 }
 
+/*
+ * Server budget accounting: the state of each SCHED_SPORADIC server is
+ * rebuilt from its sched_ss_* events and the context switches of its
+ * task.  A server is in the foreground from a prio change to a higher
+ * priority until one to a lower priority.  Group servers, which have
+ * no task, are left out.
+ */
+struct ss_server {
+	struct list_head	list;
+	u32			pid;
+	char			comm[16];
+
+	bool			bg;
+	u64			run_start;	/* 0 while not running */
+	u64			wake_time;	/* 0 unless waiting for fg */
+	u64			exhaust_time;	/* 0 unless exhausted */
+	u64			repl_time;	/* last replenishment */
+	u64			first_time;
+	u64			last_time;
+
+	u64			fg_runtime;
+	u64			bg_runtime;
+
+	/* fg runtime between two replenishments */
+	u64			period_runtime;
+	u64			nr_periods;
+	u64			period_sum;
+	u64			period_max;
+
+	u64			nr_exhaust;
+	u64			exhaust_sum;
+	u64			exhaust_max;
+
+	/* wakeup to first fg run */
+	u64			nr_lat;
+	u64			lat_sum;
+	u64			lat_max;
+	u64			lat_max_at;
+
+	u64			nr_overrun;
+	u64			overrun_max;
+};
+
+static LIST_HEAD(ss_servers);
+static bool ss_timeline;
+static int ss_pid = -1;
+
+static struct ss_server *ss_server__find(u32 pid)
+{
+	struct ss_server *s;
+
+	list_for_each_entry(s, &ss_servers, list)
+		if (s->pid == pid)
+			return s;
+
+	return NULL;
+}
+
+static struct ss_server *ss_server__findnew(u32 pid, const char *comm)
+{
+	struct ss_server *s = ss_server__find(pid);
+
+	if (s)
+		return s;
+
+	s = zalloc(sizeof(*s));
+	if (!s)
+		die("No memory");
+
+	s->pid = pid;
+	strncpy(s->comm, comm, sizeof(s->comm) - 1);
+	list_add_tail(&s->list, &ss_servers);
+
+	return s;
+}
+
+static void ss_server__account(struct ss_server *s, u64 timestamp)
+{
+	u64 delta;
+
+	if (!s->first_time)
+		s->first_time = timestamp;
+	s->last_time = timestamp;
+
+	if (!s->run_start)
+		return;
+
+	delta = timestamp - s->run_start;
+	if (s->bg) {
+		s->bg_runtime += delta;
+	} else {
+		s->fg_runtime += delta;
+		s->period_runtime += delta;
+	}
+	s->run_start = timestamp;
+}
+
+/* a waiting wakeup is served once the server runs in the foreground */
+static void ss_server__fg_run(struct ss_server *s, u64 timestamp)
+{
+	u64 lat;
+
+	if (!s->wake_time)
+		return;
+
+	lat = timestamp - s->wake_time;
+	s->nr_lat++;
+	s->lat_sum += lat;
+	if (lat > s->lat_max) {
+		s->lat_max = lat;
+		s->lat_max_at = timestamp;
+	}
+	s->wake_time = 0;
+}
+
+static bool ss_timeline_print(struct ss_server *s, u64 timestamp, int cpu,
+			      const char *what)
+{
+	if (!ss_timeline || (ss_pid != -1 && (u32)ss_pid != s->pid))
+		return false;
+
+	printf("  %15.6f [%03d] %16s:%-6d %-11s", (double)timestamp/1e9,
+	       cpu, s->comm, s->pid, what);
+	return true;
+}
+
+static void
+server_switch_event(struct trace_switch_event *switch_event,
+		    struct perf_session *session __used,
+		    struct event *event __used,
+		    int cpu,
+		    u64 timestamp,
+		    struct thread *thread __used)
+{
+	struct ss_server *s;
+
+	s = ss_server__find(switch_event->prev_pid);
+	if (s && s->run_start) {
+		ss_server__account(s, timestamp);
+		s->run_start = 0;
+		if (ss_timeline_print(s, timestamp, cpu, "out"))
+			printf(" fg %.3f ms bg %.3f ms\n",
+			       (double)s->fg_runtime/1e6,
+			       (double)s->bg_runtime/1e6);
+	}
+
+	s = ss_server__find(switch_event->next_pid);
+	if (s) {
+		ss_server__account(s, timestamp);
+		s->run_start = timestamp;
+		if (!s->bg)
+			ss_server__fg_run(s, timestamp);
+		if (ss_timeline_print(s, timestamp, cpu,
+				      s->bg ? "in-bg" : "in-fg"))
+			printf(" prio %d\n", switch_event->next_prio);
+	}
+}
+
+static void
+server_wakeup_event(struct trace_wakeup_event *wakeup_event,
+		    struct perf_session *session __used,
+		    struct event *event __used,
+		    int cpu,
+		    u64 timestamp,
+		    struct thread *thread __used)
+{
+	struct ss_server *s = ss_server__find(wakeup_event->pid);
+
+	if (!s || !wakeup_event->success || s->wake_time)
+		return;
+
+	s->wake_time = timestamp;
+	if (ss_timeline_print(s, timestamp, cpu, "wakeup"))
+		printf("\n");
+}
+
+static void
+server_ss_event(struct trace_ss_event *ss_event,
+		struct perf_session *session,
+		struct event *event,
+		int cpu,
+		u64 timestamp,
+		struct thread *thread __used)
+{
+	const char *name = event->name + strlen("sched_ss_");
+	struct ss_server *s;
+	struct thread *task;
+
+	if (ss_event->pid == (u32)-1)
+		return;
+
+	task = perf_session__findnew(session, ss_event->pid);
+	s = ss_server__findnew(ss_event->pid,
+			       ss_event->comm[0] ? ss_event->comm :
+			       task ? task->comm : "<unknown>");
+	ss_server__account(s, timestamp);
+
+	if (!strcmp(name, "replenish")) {
+		if (s->repl_time) {
+			s->nr_periods++;
+			s->period_sum += s->period_runtime;
+			if (s->period_runtime > s->period_max)
+				s->period_max = s->period_runtime;
+		}
+		s->period_runtime = 0;
+		s->repl_time = timestamp;
+	} else if (!strcmp(name, "exhaust")) {
+		s->nr_exhaust++;
+		if (!s->exhaust_time)
+			s->exhaust_time = timestamp;
+	} else if (!strcmp(name, "prio_change")) {
+		s->bg = ss_event->newprio > ss_event->oldprio;
+		if (!s->bg && s->exhaust_time) {
+			u64 delta = timestamp - s->exhaust_time;
+
+			s->exhaust_sum += delta;
+			if (delta > s->exhaust_max)
+				s->exhaust_max = delta;
+			s->exhaust_time = 0;
+		}
+		if (!s->bg && s->run_start)
+			ss_server__fg_run(s, timestamp);
+	} else if (!strcmp(name, "overrun")) {
+		s->nr_overrun++;
+		if (ss_event->overrun > s->overrun_max)
+			s->overrun_max = ss_event->overrun;
+	}
+
+	if (!ss_timeline_print(s, timestamp, cpu, name))
+		return;
+
+	if (!strcmp(name, "prio_change"))
+		printf(" %d => %d (%s)", ss_event->oldprio, ss_event->newprio,
+		       s->bg ? "bg" : "fg");
+	else if (!strcmp(name, "overrun"))
+		printf(" %.3f ms", (double)ss_event->overrun/1e6);
+	else if (!strcmp(name, "period_skip"))
+		printf(" %u periods", ss_event->periods);
+	printf(" budget %.3f ms", (double)ss_event->budget/1e6);
+	if (strcmp(name, "overrun") && strcmp(name, "period_skip"))
+		printf(" usage %.3f ms", (double)ss_event->usage/1e6);
+	printf("\n");
+}
+
+static struct trace_sched_handler server_ops  = {
+	.wakeup_event		= server_wakeup_event,
+	.switch_event		= server_switch_event,
+	.ss_event		= server_ss_event,
+};
+
+static double avg_ms(u64 sum, u64 nr)
+{
+	return nr ? (double)sum/nr/1e6 : 0.0;
+}
+
+static void output_ss_server(struct ss_server *s)
+{
+	u64 elapsed = s->last_time - s->first_time;
+	char name[32];
+
+	snprintf(name, sizeof(name), "%s:%d", s->comm, s->pid);
+
+	printf("  %-22s | %9.3f | %9.3f | %7.2f | %7" PRIu64 " | %7.3f | %7.3f "
+	       "| %5" PRIu64 " | %7.3f | %7.3f | %7.3f | %7.3f | %5" PRIu64 " |\n",
+	       name, (double)s->fg_runtime/1e6, (double)s->bg_runtime/1e6,
+	       elapsed ? (double)s->fg_runtime * 100.0 / elapsed : 0.0,
+	       s->nr_periods, avg_ms(s->period_sum, s->nr_periods),
+	       (double)s->period_max/1e6,
+	       s->nr_exhaust, avg_ms(s->exhaust_sum, s->nr_exhaust),
+	       (double)s->exhaust_max/1e6,
+	       avg_ms(s->lat_sum, s->nr_lat), (double)s->lat_max/1e6,
+	       s->nr_overrun);
+
+	if (verbose)
+		printf("  %-22s   max wakeup to fg latency at %.6f secs, "
+		       "max overrun %.3f ms\n", "", (double)s->lat_max_at/1e9,
+		       (double)s->overrun_max/1e6);
+}
+
+static void __cmd_server(void)
+{
+	struct ss_server *s;
+
+	setup_pager();
+	read_events();
+
+	if (ss_timeline) {
+		print_bad_events();
+		return;
+	}
+
+	printf("\n -------------------------------------------------------------------------------------------------------------------------------------------------\n");
+	printf("  %-22s | %-21s | %-7s | %-27s | %-25s | %-17s | %-5s |\n",
+	       "", "Runtime ms", "", "fg ms per replenishment",
+	       "Exhaustions, ms", "Wakeup to fg ms", "");
+	printf("  %-22s | %9s | %9s | %7s | %7s | %7s | %7s | %5s | %7s | %7s "
+	       "| %7s | %7s | %5s |\n", "Server", "fg", "bg", "fg %",
+	       "Periods", "Avg", "Max", "Count", "Avg", "Max", "Avg", "Max",
+	       "Ovrun");
+	printf(" -------------------------------------------------------------------------------------------------------------------------------------------------\n");
+
+	list_for_each_entry(s, &ss_servers, list)
+		if (ss_pid == -1 || (u32)ss_pid == s->pid)
+			output_ss_server(s);
+
+	printf(" -------------------------------------------------------------------------------------------------------------------------------------------------\n");
+
+	print_bad_events();
+	printf("\n");
+}
+
+/*
+ * Server simulation: the jobs of the recorded tasks, or of a synthetic
+ * task set, are run under SCHED_SPORADIC servers for each budget and
+ * period asked for, see util/ss-sim.c.  A recorded job starts with a
+ * wakeup and ends when its task blocks, its cost is the cpu time the
+ * task got in between.  The servers given with --server keep their
+ * parameters, the others take --budget and --period, so that one server
+ * can be sized while the rest stay as they are.
+ */
+struct sim_task {
+	struct list_head	list;
+	u32			pid;
+	char			comm[16];
+	u32			prio;		/* highest seen */
+	bool			active;		/* a job is open */
+	u64			run_start;	/* 0 while not running */
+
+	struct ss_sim_job	*jobs;
+	unsigned int		nr_jobs;
+	unsigned int		nr_alloc;
+};
+
+/* a server given with --server, for the task of that pid or number */
+struct sim_server {
+	struct list_head	list;
+	u32			id;
+	u64			budget;
+	u64			period;
+	int			mode;		/* -1 for --mode */
+};
+
+static LIST_HEAD(sim_tasks);
+static LIST_HEAD(sim_servers);
+static struct ss_sim_params sim_params;
+static bool *sim_fixed;
+static int sim_pid = -1;
+static const char *sim_budget = "2000";
+static const char *sim_period = "10000";
+static const char *sim_mode = "sporadic";
+static const char *sim_bg = "suspend";
+static unsigned int sim_max_repl = 4;
+static int sim_low_prio;
+static u64 sim_latency;
+static u64 sim_deadline;
+static u64 sim_horizon;
+static unsigned int sim_nr_tasks;
+static unsigned int sim_nr_jobs = 1000;
+static u64 sim_interval = 10000;
+static u64 sim_cost = 1000;
+static bool sim_poisson;
+static unsigned int sim_seed = 1;
+
+static int sim_parse_mode(const char *str)
+{
+	if (!strcmp(str, "sporadic"))
+		return SS_SIM_SPORADIC;
+	if (!strcmp(str, "polling"))
+		return SS_SIM_POLLING;
+	if (!strcmp(str, "deferrable"))
+		return SS_SIM_DEFERRABLE;
+
+	return -1;
+}
+
+/* "id=budget:period[:mode]", times in us */
+static int sim_parse_server(const struct option *opt __used, const char *str,
+			    int unset __used)
+{
+	unsigned long long budget, period;
+	struct sim_server *server;
+	char mode[16] = "";
+	unsigned int id;
+	int n, m = -1;
+
+	n = sscanf(str, "%u=%llu:%llu:%15s", &id, &budget, &period, mode);
+	if (n < 3 || !budget || budget > period)
+		return error("Bad --server: `%s'", str);
+	if (n == 4) {
+		m = sim_parse_mode(mode);
+		if (m < 0)
+			return error("Unknown mode in --server: `%s'", str);
+	}
+
+	server = zalloc(sizeof(*server));
+	if (!server)
+		die("No memory");
+
+	server->id = id;
+	server->budget = budget * 1000;
+	server->period = period * 1000;
+	server->mode = m;
+	list_add_tail(&server->list, &sim_servers);
+
+	return 0;
+}
+
+/* the server of task i, the one given with --server for id if any */
+static void sim_task__set_server(struct ss_sim_task *task, unsigned int i,
+				 u32 id)
+{
+	struct sim_server *server;
+
+	task->params = sim_params;
+
+	list_for_each_entry(server, &sim_servers, list) {
+		if (server->id != id)
+			continue;
+
+		task->params.budget = server->budget;
+		task->params.period = server->period;
+		if (server->mode >= 0)
+			task->params.mode = server->mode;
+		sim_fixed[i] = true;
+		break;
+	}
+}
+
+static struct sim_task *sim_task__findnew(u32 pid, const char *comm, u32 prio)
+{
+	struct sim_task *t;
+
+	/* only rt tasks are served, unless one is asked for */
+	if (sim_pid != -1 ? (u32)sim_pid != pid : prio >= 100)
+		return NULL;
+
+	list_for_each_entry(t, &sim_tasks, list) {
+		if (t->pid == pid) {
+			if (prio < t->prio)
+				t->prio = prio;
+			return t;
+		}
+	}
+
+	t = zalloc(sizeof(*t));
+	if (!t)
+		die("No memory");
+
+	t->pid = pid;
+	t->prio = prio;
+	strncpy(t->comm, comm, sizeof(t->comm) - 1);
+	list_add_tail(&t->list, &sim_tasks);
+
+	return t;
+}
+
+static struct ss_sim_job *sim_task__add_job(struct sim_task *t, u64 arrival)
+{
+	struct ss_sim_job *job;
+
+	if (t->nr_jobs == t->nr_alloc) {
+		t->nr_alloc = t->nr_alloc ? t->nr_alloc * 2 : 64;
+		t->jobs = realloc(t->jobs, t->nr_alloc * sizeof(*t->jobs));
+		if (!t->jobs)
+			die("No memory");
+	}
+
+	job = &t->jobs[t->nr_jobs++];
+	job->arrival = arrival;
+	job->cost = 0;
+
+	return job;
+}
+
+static void
+sim_switch_event(struct trace_switch_event *switch_event,
+		 struct perf_session *session __used,
+		 struct event *event __used,
+		 int cpu __used,
+		 u64 timestamp,
+		 struct thread *thread __used)
+{
+	struct sim_task *t;
+
+	t = sim_task__findnew(switch_event->prev_pid, switch_event->prev_comm,
+			      switch_event->prev_prio);
+	if (t && t->run_start) {
+		t->jobs[t->nr_jobs - 1].cost += timestamp - t->run_start;
+		t->run_start = 0;
+		if (switch_event->prev_state)
+			t->active = false;
+	}
+
+	t = sim_task__findnew(switch_event->next_pid, switch_event->next_comm,
+			      switch_event->next_prio);
+	if (t && t->active)
+		t->run_start = timestamp;
+}
+
+static void
+sim_wakeup_event(struct trace_wakeup_event *wakeup_event,
+		 struct perf_session *session __used,
+		 struct event *event __used,
+		 int cpu __used,
+		 u64 timestamp,
+		 struct thread *thread __used)
+{
+	struct sim_task *t;
+
+	if (!wakeup_event->success)
+		return;
+
+	t = sim_task__findnew(wakeup_event->pid, wakeup_event->comm,
+			      wakeup_event->prio);
+	if (!t || t->active)
+		return;
+
+	sim_task__add_job(t, timestamp);
+	t->active = true;
+}
+
+static struct trace_sched_handler sim_ops  = {
+	.wakeup_event		= sim_wakeup_event,
+	.switch_event		= sim_switch_event,
+};
+
+static int sim_task_cmp(const void *a, const void *b)
+{
+	const struct sim_task *l = *(const struct sim_task * const *)a;
+	const struct sim_task *r = *(const struct sim_task * const *)b;
+
+	if (l->prio != r->prio)
+		return l->prio < r->prio ? -1 : 1;
+
+	return l->pid < r->pid ? -1 : l->pid > r->pid;
+}
+
+/* the recorded tasks with their jobs, from the highest priority down */
+static struct ss_sim_task *sim_read_tasks(unsigned int *nr)
+{
+	struct sim_task **sorted, *t;
+	struct ss_sim_task *sim;
+	u64 start = ~0ULL;
+	unsigned int i, j, n = 0;
+
+	read_events();
+
+	list_for_each_entry(t, &sim_tasks, list) {
+		/* the last job was still going when the trace stopped */
+		if (t->active)
+			t->nr_jobs--;
+		if (!t->nr_jobs)
+			continue;
+		if (t->jobs[0].arrival < start)
+			start = t->jobs[0].arrival;
+		n++;
+	}
+
+	*nr = n;
+	if (!n)
+		return NULL;
+
+	sorted = calloc(n, sizeof(*sorted));
+	sim = calloc(n, sizeof(*sim));
+	sim_fixed = calloc(n, sizeof(*sim_fixed));
+	if (!sorted || !sim || !sim_fixed)
+		die("No memory");
+
+	i = 0;
+	list_for_each_entry(t, &sim_tasks, list)
+		if (t->nr_jobs)
+			sorted[i++] = t;
+	qsort(sorted, n, sizeof(*sorted), sim_task_cmp);
+
+	for (i = 0; i < n; i++) {
+		char *name = malloc(32);
+
+		t = sorted[i];
+		if (!name)
+			die("No memory");
+		snprintf(name, 32, "%s:%d", t->comm, t->pid);
+
+		for (j = 0; j < t->nr_jobs; j++)
+			t->jobs[j].arrival -= start;
+
+		sim[i].name = name;
+		/* as for a SCHED_FIFO task at the priority it had */
+		sim[i].prio = t->prio < 99 ? 99 - t->prio : 1;
+		sim[i].jobs = t->jobs;
+		sim[i].nr_jobs = t->nr_jobs;
+		sim[i].deadline = sim_deadline * 1000;
+		sim_task__set_server(&sim[i], i, t->pid);
+	}
+
+	free(sorted);
+
+	return sim;
+}
+
+/* sim_nr_tasks identical tasks, periodic or with Poisson arrivals */
+static struct ss_sim_task *sim_make_tasks(unsigned int *nr)
+{
+	u64 interval = sim_interval * 1000;
+	struct ss_sim_task *sim;
+	unsigned int i, j;
+
+	sim = calloc(sim_nr_tasks, sizeof(*sim));
+	sim_fixed = calloc(sim_nr_tasks, sizeof(*sim_fixed));
+	if (!sim || !sim_fixed)
+		die("No memory");
+
+	srand48(sim_seed);
+
+	for (i = 0; i < sim_nr_tasks; i++) {
+		char *name = malloc(32);
+		double arrival = 0;
+
+		sim[i].jobs = calloc(sim_nr_jobs, sizeof(*sim[i].jobs));
+		if (!name || !sim[i].jobs)
+			die("No memory");
+		snprintf(name, 32, "task-%u", i);
+
+		for (j = 0; j < sim_nr_jobs; j++) {
+			if (sim_poisson)
+				arrival -= log(1.0 - drand48()) * interval;
+			else if (j)
+				arrival += interval;
+			sim[i].jobs[j].arrival = arrival;
+			sim[i].jobs[j].cost = sim_cost * 1000;
+		}
+
+		sim[i].name = name;
+		/* task-0 first, the last ones share the lowest priority */
+		sim[i].prio = i < 98 ? 99 - i : 1;
+		sim[i].nr_jobs = sim_nr_jobs;
+		sim[i].deadline = (sim_deadline ?: sim_interval) * 1000;
+		sim_task__set_server(&sim[i], i, i);
+	}
+
+	*nr = sim_nr_tasks;
+
+	return sim;
+}
+
+/* "us" or "lo:hi:step" in us */
+static int sim_parse_range(const char *str, u64 range[3])
+{
+	unsigned long long lo, hi, step;
+	int n = sscanf(str, "%llu:%llu:%llu", &lo, &hi, &step);
+
+	if (n < 1 || !lo)
+		return -1;
+	if (n < 2)
+		hi = lo;
+	if (n < 3)
+		step = hi - lo ?: 1;
+	if (hi < lo || !step)
+		return -1;
+
+	range[0] = lo * 1000;
+	range[1] = hi * 1000;
+	range[2] = step * 1000;
+
+	return 0;
+}
+
+static int sim_u64_cmp(const void *a, const void *b)
+{
+	u64 l = *(const u64 *)a, r = *(const u64 *)b;
+
+	return l < r ? -1 : l > r;
+}
+
+/* sorts resp */
+static u64 sim_percentile(struct ss_sim_task *task, unsigned int pct)
+{
+	if (!task->nr_done)
+		return 0;
+
+	qsort(task->resp, task->nr_done, sizeof(u64), sim_u64_cmp);
+
+	return task->resp[(u64)(task->nr_done - 1) * pct / 100];
+}
+
+static void output_sim_task(struct ss_sim_task *task, u64 end)
+{
+	u64 sum = 0, p50, p99, max_resp = 0;
+	unsigned int i;
+
+	for (i = 0; i < task->nr_done; i++)
+		sum += task->resp[i];
+
+	p50 = sim_percentile(task, 50);
+	p99 = sim_percentile(task, 99);
+	if (task->nr_done)
+		max_resp = task->resp[task->nr_done - 1];
+
+	printf("  %-22s | %7u | %9.3f | %9.3f | %9.3f | %9.3f | %6u | %7" PRIu64
+	       " | %7" PRIu64 " | %7.3f | %6.2f | %6.2f |\n",
+	       task->name, task->nr_done, avg_ms(sum, task->nr_done),
+	       (double)p50/1e6, (double)p99/1e6, (double)max_resp/1e6,
+	       task->nr_miss, task->nr_exhaust, task->nr_overrun,
+	       (double)task->overrun_max/1e6,
+	       end ? (double)task->fg_runtime * 100.0 / end : 0.0,
+	       end ? (double)task->bg_runtime * 100.0 / end : 0.0);
+}
+
+static void output_sim_run(struct ss_sim_task *sim, unsigned int nr,
+			   u64 budget, u64 period, u64 end)
+{
+	u64 p99 = 0, max_resp = 0, runtime = 0, exhaust = 0, overrun = 0;
+	unsigned int i, miss = 0, left = 0;
+
+	for (i = 0; i < nr; i++) {
+		struct ss_sim_task *task = &sim[i];
+		u64 v = sim_percentile(task, 99);
+
+		if (v > p99)
+			p99 = v;
+		if (task->nr_done && task->resp[task->nr_done - 1] > max_resp)
+			max_resp = task->resp[task->nr_done - 1];
+		miss += task->nr_miss;
+		left += task->nr_jobs - task->nr_done;
+		exhaust += task->nr_exhaust;
+		overrun += task->nr_overrun;
+		runtime += task->fg_runtime + task->bg_runtime;
+	}
+
+	printf("  %9.3f | %9.3f | %9.3f | %9.3f | %6u | %6u | %7" PRIu64
+	       " | %7" PRIu64 " | %6.2f |\n",
+	       (double)budget/1e6, (double)period/1e6, (double)p99/1e6, (double)max_resp/1e6, miss, left, exhaust, overrun,
+	       end ? (double)runtime * 100.0 / end : 0.0);
+}
+
+static int __cmd_simulate(void)
+{
+	u64 budget[3], period[3], b, p, nr_sims = 0, T0, end;
+	struct ss_sim_task *sim;
+	unsigned int i, nr;
+	bool sweep;
+
+	sim_params.mode = sim_parse_mode(sim_mode);
+	if (sim_params.mode < 0)
+		return error("Unknown --mode: `%s'", sim_mode);
+
+	if (!strcmp(sim_bg, "suspend"))
+		sim_params.bg = SS_SIM_BG_SUSPEND;
+	else if (!strcmp(sim_bg, "rt"))
+		sim_params.bg = SS_SIM_BG_RT;
+	else
+		return error("Unknown --bg: `%s'", sim_bg);
+
+	if (sim_low_prio < 0 || sim_low_prio > 99)
+		return error("--low-prio must be 0 to 99");
+	sim_params.low_prio = sim_low_prio;
+
+	if (!sim_max_repl || sim_max_repl > SS_SIM_REPL_MAX)
+		return error("--max-repl must be 1 to %d", SS_SIM_REPL_MAX);
+	sim_params.max_repl = sim_max_repl;
+
+	if (sim_parse_range(sim_budget, budget) < 0)
+		return error("Bad --budget: `%s'", sim_budget);
+	if (sim_parse_range(sim_period, period) < 0)
+		return error("Bad --period: `%s'", sim_period);
+	sweep = budget[0] != budget[1] || period[0] != period[1];
+	if (!sweep && budget[0] > period[0])
+		return error("--budget is over --period");
+	if (sim_nr_tasks && (!sim_nr_jobs || !sim_interval))
+		return error("--jobs and --interval must not be 0");
+
+	if (sim_nr_tasks) {
+		sim = sim_make_tasks(&nr);
+	} else {
+		setup_pager();
+		sim = sim_read_tasks(&nr);
+		if (!nr)
+			return error("No rt task in the trace, pick one with --pid");
+	}
+
+	for (i = 0; i < nr; i++) {
+		sim[i].resp = calloc(sim[i].nr_jobs, sizeof(u64));
+		if (!sim[i].resp)
+			die("No memory");
+	}
+
+	if (sweep) {
+		printf("\n -----------------------------------------------------------------------------------------------------\n");
+		printf("  %9s | %9s | %9s | %9s | %6s | %6s | %7s | %7s | %6s |\n",
+		       "Budget ms", "Period ms", "p99 ms", "Max ms", "Misses",
+		       "Left", "Exhaust", "Ovrun", "Util %");
+		printf(" -----------------------------------------------------------------------------------------------------\n");
+	} else {
+		printf("\n -------------------------------------------------------------------------------------------------------------------------------------\n");
+		printf("  %-22s | %-7s | %-39s | %-6s | %-7s | %-17s | %-15s |\n",
+		       "", "", "Response time ms", "", "",
+		       "Overruns", "Cpu %");
+		printf("  %-22s | %7s | %9s | %9s | %9s | %9s | %6s | %7s | %7s "
+		       "| %7s | %6s | %6s |\n", "Task", "Jobs", "Avg", "p50",
+		       "p99", "Max", "Misses", "Exhaust", "Count", "Max ms",
+		       "fg", "bg");
+		printf(" -------------------------------------------------------------------------------------------------------------------------------------\n");
+	}
+
+	T0 = get_nsecs();
+
+	for (p = period[0]; p <= period[1]; p += period[2]) {
+		for (b = budget[0]; b <= budget[1]; b += budget[2]) {
+			if (b > p)
+				break;
+
+			for (i = 0; i < nr; i++) {
+				if (sim_fixed[i])
+					continue;
+				sim[i].params.budget = b;
+				sim[i].params.period = p;
+			}
+
+			if (ss_sim_run(sim, nr, sim_latency * 1000,
+				       sim_horizon * 1000, &end) < 0)
+				die("No memory");
+			nr_sims++;
+
+			if (sweep) {
+				output_sim_run(sim, nr, b, p, end);
+				continue;
+			}
+			for (i = 0; i < nr; i++)
+				output_sim_task(&sim[i], end);
+		}
+	}
+
+	if (sweep)
+		printf(" -----------------------------------------------------------------------------------------------------\n");
+	else
+		printf(" -------------------------------------------------------------------------------------------------------------------------------------\n");
+
+	if (verbose)
+		printf("  %" PRIu64 " simulations in %.3f secs\n", nr_sims,
+		       (double)(get_nsecs() - T0)/1e9);
+	printf("\n");
+
+	return 0;
+}
+
 static void __cmd_replay(void)
 {
 	unsigned long i;
@@ -1769,7 +2677,7 @@ static void __cmd_replay(void)
 
 
 static const char * const sched_usage[] = {
-	"perf sched [<options>] {record|latency|map|replay|trace}",
+	"perf sched [<options>] {record|latency|map|replay|server|simulate|trace}",
 	NULL
 };
 
@@ -1815,6 +2723,71 @@ static const struct option replay_options[] = {
 	OPT_END()
 };
 
+static const char * const server_usage[] = {
+	"perf sched server [<options>]",
+	NULL
+};
+
+static const struct option server_options[] = {
+	OPT_BOOLEAN('t', "timeline", &ss_timeline,
+		    "show the events of the servers instead of a summary"),
+	OPT_INTEGER('p', "pid", &ss_pid,
+		    "only show the server of this pid"),
+	OPT_INCR('v', "verbose", &verbose,
+		    "be more verbose (show symbol address, etc)"),
+	OPT_BOOLEAN('D', "dump-raw-trace", &dump_trace,
+		    "dump raw trace in ASCII"),
+	OPT_END()
+};
+
+static const char * const simulate_usage[] = {
+	"perf sched simulate [<options>]",
+	NULL
+};
+
+static const struct option simulate_options[] = {
+	OPT_STRING('b', "budget", &sim_budget, "us[:us:us]",
+		   "server budget, or lo:hi:step to sweep (default 2000)"),
+	OPT_STRING('P', "period", &sim_period, "us[:us:us]",
+		   "server period, or lo:hi:step to sweep (default 10000)"),
+	OPT_STRING('m', "mode", &sim_mode, "mode",
+		   "server mode: sporadic, polling or deferrable"),
+	OPT_STRING(0, "bg", &sim_bg, "policy",
+		   "what an exhausted server does: suspend or rt"),
+	OPT_INTEGER(0, "low-prio", &sim_low_prio,
+		    "rt priority of a server in bg with --bg rt (default 0)"),
+	OPT_CALLBACK('s', "server", NULL, "id=us:us[:mode]",
+		     "server of the task of this pid, or synthetic task number",
+		     sim_parse_server),
+	OPT_UINTEGER('r', "max-repl", &sim_max_repl,
+		     "pending replenishments of a sporadic server"),
+	OPT_U64('l', "latency", &sim_latency,
+		"us it takes to enforce an exhaustion"),
+	OPT_U64('d', "deadline", &sim_deadline,
+		"relative deadline of the jobs in us (default: --interval)"),
+	OPT_U64(0, "horizon", &sim_horizon,
+		"us to simulate (default: until all jobs are done)"),
+	OPT_INTEGER('p', "pid", &sim_pid,
+		    "only simulate the task of this pid"),
+	OPT_UINTEGER('t', "tasks", &sim_nr_tasks,
+		     "simulate this many synthetic tasks instead of the trace"),
+	OPT_UINTEGER('n', "jobs", &sim_nr_jobs,
+		     "jobs per synthetic task"),
+	OPT_U64(0, "interval", &sim_interval,
+		"us between the jobs of a synthetic task (mean if --poisson)"),
+	OPT_U64(0, "cost", &sim_cost,
+		"us of cpu time per synthetic job"),
+	OPT_BOOLEAN(0, "poisson", &sim_poisson,
+		    "synthetic jobs arrive as a Poisson process"),
+	OPT_UINTEGER(0, "seed", &sim_seed,
+		     "seed of the --poisson arrivals"),
+	OPT_INCR('v', "verbose", &verbose,
+		    "be more verbose (show symbol address, etc)"),
+	OPT_BOOLEAN('D', "dump-raw-trace", &dump_trace,
+		    "dump raw trace in ASCII"),
+	OPT_END()
+};
+
 static void setup_sorting(void)
 {
 	char *tmp, *tok, *str = strdup(sort_order);
@@ -1848,6 +2821,11 @@ static const char *record_args[] = {
 	"-e", "sched:sched_process_fork",
 	"-e", "sched:sched_wakeup",
 	"-e", "sched:sched_migrate_task",
+	"-e", "sched:sched_ss_replenish",
+	"-e", "sched:sched_ss_exhaust",
+	"-e", "sched:sched_ss_overrun",
+	"-e", "sched:sched_ss_period_skip",
+	"-e", "sched:sched_ss_prio_change",
 };
 
 static int __cmd_record(int argc, const char **argv)
@@ -1909,6 +2887,22 @@ int cmd_sched(int argc, const char **argv, const char *prefix __used)
 				usage_with_options(replay_usage, replay_options);
 		}
 		__cmd_replay();
+	} else if (!strncmp(argv[0], "ser", 3)) {
+		trace_handler = &server_ops;
+		if (argc > 1) {
+			argc = parse_options(argc, argv, server_options, server_usage, 0);
+			if (argc)
+				usage_with_options(server_usage, server_options);
+		}
+		__cmd_server();
+	} else if (!strncmp(argv[0], "sim", 3)) {
+		trace_handler = &sim_ops;
+		if (argc > 1) {
+			argc = parse_options(argc, argv, simulate_options, simulate_usage, 0);
+			if (argc)
+				usage_with_options(simulate_usage, simulate_options);
+		}
+		return __cmd_simulate();
 	} else {
 		usage_with_options(sched_usage, sched_options);
 	}
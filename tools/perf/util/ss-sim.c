@@ -0,0 +1,453 @@
+/*
+ * Discrete-event simulation of SCHED_SPORADIC servers
+ *
+ * The helpers below that share a name with one in kernel/sched_rt.c do what
+ * it does, on a simulated clock.  One cpu is simulated, each task running
+ * at the fg priority of its server, or at its low priority in bg with
+ * SS_SIM_BG_RT, ties going to the task given first.  Between two events (a job arriving or completing,
+ * capacity coming back, a server running out) the task picked runs
+ * undisturbed, so a simulation costs in events rather than in time.
+ *
+ * Not modelled: slack reclaiming, priority inheritance, adaptive budgets,
+ * migration and the cost of switching.
+ */
+
+#include "ss-sim.h"
+
+#include <errno.h>
+#include <stdlib.h>
+
+struct ss_sim_repl {
+	s64			amt;
+	u64			time;
+};
+
+struct ss_sim_server {
+	struct ss_sim_task		*task;
+	const struct ss_sim_params	*params;
+
+	/* ring of max_repl + 1 entries: the front one and the pending ones */
+	struct ss_sim_repl	*repl_list;
+	unsigned int		repl_head;
+	unsigned int		nr_repl;
+	s64			usage;
+	s64			debt;
+	u64			act_time;
+	bool			fg;
+
+	/* polling and deferrable: the next period boundary, if armed */
+	u64			repl_expires;
+	bool			queued;
+
+	/* jobs arrived, the first one not done and what is left of it */
+	unsigned int		arrived;
+	unsigned int		cur;
+	u64			left;
+};
+
+static inline unsigned int ss_rl_idx(struct ss_sim_server *ss, unsigned int i)
+{
+	return (ss->repl_head + i) % (ss->params->max_repl + 1);
+}
+
+static inline struct ss_sim_repl *ss_rl_front(struct ss_sim_server *ss)
+{
+	return &ss->repl_list[ss->repl_head];
+}
+
+static inline struct ss_sim_repl *ss_rl_next(struct ss_sim_server *ss)
+{
+	return &ss->repl_list[ss_rl_idx(ss, 1)];
+}
+
+static inline struct ss_sim_repl *ss_rl_last(struct ss_sim_server *ss)
+{
+	return &ss->repl_list[ss_rl_idx(ss, ss->nr_repl)];
+}
+
+static inline bool ss_periodic(struct ss_sim_server *ss)
+{
+	return ss->params->mode != SS_SIM_SPORADIC;
+}
+
+static inline s64 ss_capacity(struct ss_sim_server *ss)
+{
+	return ss_rl_front(ss)->amt - ss->usage;
+}
+
+static inline bool ss_ready(struct ss_sim_server *ss)
+{
+	return ss->cur < ss->arrived;
+}
+
+static s64 ss_debit(struct ss_sim_server *ss, s64 amt)
+{
+	if (ss->debt >= amt) {
+		ss->debt -= amt;
+		return 0;
+	}
+
+	amt -= ss->debt;
+	ss->debt = 0;
+
+	return amt;
+}
+
+/*
+ * The activation that started at act_time is over: what it used comes back
+ * one period later, anything beyond the front capacity is an overrun.
+ */
+static void ss_split_check(struct ss_sim_server *ss)
+{
+	struct ss_sim_task *task = ss->task;
+	struct ss_sim_repl *front = ss_rl_front(ss);
+	struct ss_sim_repl repl;
+	s64 overrun = 0;
+
+	if (ss->usage <= 0) {
+		ss->usage = 0;
+		return;
+	}
+
+	repl.amt = ss->usage;
+	repl.time = ss->act_time + ss->params->period;
+
+	if (repl.amt > front->amt) {
+		overrun = repl.amt - front->amt;
+		task->nr_overrun++;
+		if ((u64)overrun > task->overrun_max)
+			task->overrun_max = overrun;
+		repl.amt = front->amt;
+	}
+	front->amt -= repl.amt;
+
+	if (ss_periodic(ss)) {
+		ss->debt += overrun;
+		ss->usage = 0;
+		return;
+	}
+
+	/* charged to the next activation */
+	ss->usage = overrun;
+
+	if (ss->nr_repl >= ss->params->max_repl) {
+		struct ss_sim_repl *last = ss_rl_last(ss);
+
+		last->amt += repl.amt;
+		last->time = repl.time;
+	} else {
+		ss->nr_repl++;
+		*ss_rl_last(ss) = repl;
+	}
+}
+
+static bool ss_rl_merge(struct ss_sim_server *ss, u64 now)
+{
+	bool merged = false;
+
+	while (ss->nr_repl && ss_rl_next(ss)->time <= now) {
+		s64 amt = ss_rl_front(ss)->amt;
+
+		ss->repl_head = ss_rl_idx(ss, 1);
+		ss->nr_repl--;
+		ss_rl_front(ss)->amt += ss_debit(ss, amt);
+		merged = true;
+	}
+
+	return merged;
+}
+
+static void ss_refill(struct ss_sim_server *ss, u64 start)
+{
+	struct ss_sim_repl *front = ss_rl_front(ss);
+
+	front->amt = ss_debit(ss, ss->params->budget);
+	front->time = start;
+
+	ss->usage = 0;
+	ss->act_time = start;
+}
+
+/* move the period boundary past @now, returns the number of periods */
+static u64 ss_fwd_repl_timer(struct ss_sim_server *ss, u64 now)
+{
+	u64 periods;
+
+	if (ss->repl_expires > now)
+		return 0;
+
+	periods = (now - ss->repl_expires) / ss->params->period + 1;
+	ss->repl_expires += periods * ss->params->period;
+
+	return periods;
+}
+
+static void ss_set_fg(struct ss_sim_server *ss, u64 act_time)
+{
+	if (ss->fg || ss_capacity(ss) <= 0)
+		return;
+
+	ss->fg = true;
+	ss->act_time = act_time;
+}
+
+static void ss_wakeup(struct ss_sim_server *ss, u64 now)
+{
+	const struct ss_sim_params *params = ss->params;
+
+	ss->left = ss->task->jobs[ss->cur].cost;
+
+	if (ss_periodic(ss) && !ss->queued) {
+		if (ss_fwd_repl_timer(ss, now) &&
+		    params->mode == SS_SIM_DEFERRABLE) {
+			ss_refill(ss, ss->repl_expires - params->period);
+			ss->task->nr_repl++;
+		}
+		ss->queued = true;
+	}
+
+	ss_set_fg(ss, now);
+}
+
+static void ss_sleep(struct ss_sim_server *ss)
+{
+	if (ss_periodic(ss))
+		ss->queued = false;
+
+	if (!ss->fg)
+		return;
+
+	/* a polling server gives up what it has left until the next period */
+	if (ss->params->mode == SS_SIM_POLLING)
+		ss->usage = ss_rl_front(ss)->amt;
+	ss_split_check(ss);
+	ss->fg = false;
+}
+
+static void ss_exhaust(struct ss_sim_server *ss)
+{
+	ss->task->nr_exhaust++;
+	ss_split_check(ss);
+	ss->fg = false;
+}
+
+static void ss_arrive(struct ss_sim_server *ss, u64 now)
+{
+	struct ss_sim_task *task = ss->task;
+	bool ready = ss_ready(ss);
+
+	while (ss->arrived < task->nr_jobs &&
+	       task->jobs[ss->arrived].arrival <= now)
+		ss->arrived++;
+
+	if (!ready && ss_ready(ss))
+		ss_wakeup(ss, now);
+}
+
+static void ss_repl(struct ss_sim_server *ss, u64 now)
+{
+	const struct ss_sim_params *params = ss->params;
+
+	if (ss_periodic(ss)) {
+		if (!ss->queued || ss->repl_expires > now)
+			return;
+		ss_fwd_repl_timer(ss, now);
+		ss_refill(ss, ss->repl_expires - params->period);
+	} else if (!ss_rl_merge(ss, now)) {
+		return;
+	}
+
+	ss->task->nr_repl++;
+	if (ss_ready(ss))
+		ss_set_fg(ss, ss_rl_front(ss)->time);
+}
+
+static void ss_job_done(struct ss_sim_server *ss, u64 now)
+{
+	struct ss_sim_task *task = ss->task;
+	u64 resp = now - task->jobs[ss->cur].arrival;
+
+	task->resp[task->nr_done++] = resp;
+	if (task->deadline && resp > task->deadline)
+		task->nr_miss++;
+	ss->cur++;
+
+	/* a job that arrived meanwhile keeps the activation going */
+	while (ss->arrived < task->nr_jobs &&
+	       task->jobs[ss->arrived].arrival <= now)
+		ss->arrived++;
+
+	if (ss_ready(ss))
+		ss->left = task->jobs[ss->cur].cost;
+	else
+		ss_sleep(ss);
+}
+
+/* the ready server at the highest priority, in fg or in bg */
+static struct ss_sim_server *ss_pick(struct ss_sim_server *servers,
+				     unsigned int nr)
+{
+	struct ss_sim_server *best = NULL;
+	int best_prio = 0;
+	unsigned int i;
+
+	for (i = 0; i < nr; i++) {
+		struct ss_sim_server *ss = &servers[i];
+		int prio;
+
+		if (!ss_ready(ss))
+			continue;
+
+		if (ss->fg)
+			prio = ss->task->prio;
+		else if (ss->params->bg == SS_SIM_BG_RT)
+			prio = ss->params->low_prio;
+		else
+			continue;
+
+		if (!best || prio > best_prio) {
+			best = ss;
+			best_prio = prio;
+		}
+	}
+
+	return best;
+}
+
+static u64 ss_next_event(struct ss_sim_server *servers, unsigned int nr,
+			 struct ss_sim_server *curr, u64 now, u64 latency)
+{
+	u64 next = ~0ULL;
+	unsigned int i;
+
+	for (i = 0; i < nr; i++) {
+		struct ss_sim_server *ss = &servers[i];
+		struct ss_sim_task *task = ss->task;
+
+		if (ss->arrived < task->nr_jobs &&
+		    task->jobs[ss->arrived].arrival < next)
+			next = task->jobs[ss->arrived].arrival;
+
+		if (ss_periodic(ss)) {
+			if (ss->queued && ss->repl_expires < next)
+				next = ss->repl_expires;
+		} else if (ss->nr_repl && ss_rl_next(ss)->time < next) {
+			next = ss_rl_next(ss)->time;
+		}
+	}
+
+	if (curr) {
+		if (now + curr->left < next)
+			next = now + curr->left;
+
+		if (curr->fg) {
+			s64 runway = ss_capacity(curr) + (s64)latency;
+
+			if (runway < 0)
+				runway = 0;
+			if (now + runway < next)
+				next = now + runway;
+		}
+	}
+
+	return next;
+}
+
+int ss_sim_run(struct ss_sim_task *tasks, unsigned int nr_tasks,
+	       u64 latency, u64 horizon, u64 *end)
+{
+	struct ss_sim_server *servers;
+	struct ss_sim_repl *rings;
+	unsigned int i, j, ring = 0;
+	u64 nr_left = 0;
+	u64 now = 0;
+
+	for (i = 0; i < nr_tasks; i++)
+		ring += tasks[i].params.max_repl + 1;
+
+	servers = calloc(nr_tasks, sizeof(*servers));
+	rings = calloc(ring, sizeof(*rings));
+	if (!servers || !rings) {
+		free(servers);
+		free(rings);
+		return -ENOMEM;
+	}
+
+	for (i = 0, ring = 0; i < nr_tasks; i++) {
+		struct ss_sim_server *ss = &servers[i];
+		struct ss_sim_task *task = &tasks[i];
+
+		ss->task = task;
+		ss->params = &task->params;
+		ss->repl_list = rings + ring;
+		ss->repl_list[0].amt = task->params.budget;
+		ss->repl_expires = task->params.period;
+		ring += task->params.max_repl + 1;
+
+		task->nr_done = task->nr_miss = 0;
+		task->fg_runtime = task->bg_runtime = 0;
+		task->nr_repl = task->nr_exhaust = 0;
+		task->nr_overrun = task->overrun_max = 0;
+
+		nr_left += task->nr_jobs;
+	}
+
+	while (nr_left) {
+		struct ss_sim_server *curr;
+		u64 next;
+
+		for (i = 0; i < nr_tasks; i++)
+			ss_arrive(&servers[i], now);
+		for (i = 0; i < nr_tasks; i++)
+			ss_repl(&servers[i], now);
+
+		curr = ss_pick(servers, nr_tasks);
+		next = ss_next_event(servers, nr_tasks, curr, now, latency);
+		if (horizon && next > horizon)
+			next = horizon;
+		/* only suspended jobs left and nothing to wake them */
+		if (next == ~0ULL)
+			break;
+
+		if (curr) {
+			u64 delta = next - now;
+
+			curr->left -= delta;
+			if (curr->fg) {
+				curr->usage += delta;
+				curr->task->fg_runtime += delta;
+			} else {
+				curr->task->bg_runtime += delta;
+			}
+		}
+		now = next;
+
+		if (curr && !curr->left) {
+			ss_job_done(curr, now);
+			nr_left--;
+		}
+		if (curr && curr->fg && -ss_capacity(curr) >= (s64)latency)
+			ss_exhaust(curr);
+
+		if (horizon && now >= horizon)
+			break;
+	}
+
+	/* jobs left over count as misses once their deadline has passed */
+	for (i = 0; i < nr_tasks; i++) {
+		struct ss_sim_task *task = &tasks[i];
+
+		if (!task->deadline)
+			continue;
+		for (j = task->nr_done; j < task->nr_jobs; j++) {
+			if (task->jobs[j].arrival + task->deadline < now)
+				task->nr_miss++;
+		}
+	}
+
+	free(servers);
+	free(rings);
+
+	*end = now;
+	return 0;
+}
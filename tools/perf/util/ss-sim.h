@@ -0,0 +1,75 @@
+#ifndef __PERF_SS_SIM_H
+#define __PERF_SS_SIM_H
+
+#include <stdbool.h>
+#include "types.h"
+
+/*
+ * Discrete-event simulation of SCHED_SPORADIC servers sharing one cpu,
+ * following the server logic of kernel/sched_rt.c.  Time is in ns.
+ */
+
+/* server modes and bg policies, as in linux/sched.h */
+#define SS_SIM_SPORADIC		0
+#define SS_SIM_POLLING		1
+#define SS_SIM_DEFERRABLE	2
+
+#define SS_SIM_BG_SUSPEND	0
+#define SS_SIM_BG_RT		1
+
+#define SS_SIM_REPL_MAX		100
+
+struct ss_sim_job {
+	u64			arrival;
+	u64			cost;
+};
+
+/* the parameters of the server of a task */
+struct ss_sim_params {
+	u64			budget;
+	u64			period;
+	int			mode;
+	int			bg;
+	/* rt priority it runs at in bg with SS_SIM_BG_RT */
+	int			low_prio;
+	unsigned int		max_repl;
+};
+
+/*
+ * A task with its server, its jobs in order of arrival and what the
+ * simulation found.  Among tasks at the same priority the first one given
+ * runs first, and resp must have room for nr_jobs entries.
+ */
+struct ss_sim_task {
+	const char		*name;
+	/* rt priority its server runs at in fg */
+	int			prio;
+	struct ss_sim_params	params;
+	struct ss_sim_job	*jobs;
+	unsigned int		nr_jobs;
+	/* relative deadline of the jobs, 0 if none */
+	u64			deadline;
+
+	/* response time of each job done */
+	u64			*resp;
+	unsigned int		nr_done;
+	unsigned int		nr_miss;
+	u64			fg_runtime;
+	u64			bg_runtime;
+	u64			nr_repl;
+	u64			nr_exhaust;
+	u64			nr_overrun;
+	u64			overrun_max;
+};
+
+/*
+ * Run the jobs of @tasks under their servers, the time simulated is stored
+ * in @end.  Exhaustion is enforced @latency late, each time is an overrun,
+ * and the simulation stops at @horizon, 0 to run until all jobs are done.
+ *
+ * @return: 0, or -ENOMEM.
+ */
+int ss_sim_run(struct ss_sim_task *tasks, unsigned int nr_tasks,
+	       u64 latency, u64 horizon, u64 *end);
+
+#endif /* __PERF_SS_SIM_H */